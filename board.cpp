@@ -15,103 +15,14 @@
 ===============================
 \*****************************/
 
-void Skunk::parse_fen(const std::string& fen) {
-    // reset board position (bitboards)
-    memset(bitboards, 0ULL, sizeof(bitboards));
 
-    // reset occupancies (bitboards)
-    memset(occupancies, 0ULL, sizeof(occupancies));
-    memset(piece_count, 0, sizeof(piece_count));
+const Tables tables;
 
-    // reset game state variables
-    side = 0;
-    enpassant = no_square;
-    castle = 0;
-
-    int square = 0;
-    size_t fen_idx = 0;
-
-    // loop over board squares
-    while (square < 64 && fen_idx < fen.length()) {
-        if (fen[fen_idx] == '/') {
-            // match rank separator
-            fen_idx++;
-            square--;
-        } else if (fen[fen_idx] >= '0' && fen[fen_idx] <= '9') {
-            // match empty square numbers within FEN string
-            square += fen[fen_idx] - '1'; // use '1' to offset the loop increment
-            fen_idx++;
-        } else {
-            // match ascii pieces within FEN string
-            int piece = char_pieces[fen[fen_idx]];
-            set_bit(bitboards[piece], square);
-            piece_count[piece]++;
-            fen_idx++;
-        }
-        square++;
-    }
-    // parse side to move
-    side = (fen[++fen_idx] == 'w') ? white : black;
-    fen_idx += 2;
-
-    // parse castling rights
-    while (fen[fen_idx] != ' ' && fen_idx < fen.length()) {
-        switch (fen[fen_idx++]) {
-            case 'K': castle |= wk; break;
-            case 'Q': castle |= wq; break;
-            case 'k': castle |= bk; break;
-            case 'q': castle |= bq; break;
-        }
-    }
-
-    // parse enpassant square
-    if (fen[++fen_idx] != '-') {
-        int file = fen[fen_idx++] - 'a';
-        int rank = 8 - (fen[fen_idx] - '0');
-        enpassant = rank * 8 + file;
-    } else {
-        enpassant = no_square;
-    }
-
-    // update occupancies
+Tables::Tables() {
     for (int piece = P; piece <= k; piece++) {
-        occupancies[piece <= K ? white : black] |= bitboards[piece];
+        char_pieces[(int)ascii_pieces[piece]] = piece;
     }
 
-    // init all occupancies
-    occupancies[both] = occupancies[white] | occupancies[black];
-
-    // init hash key
-    zobrist = generate_zobrist();
-
-    init();
-
-}
-
-
-
-void Skunk::fill_occupancies() {
-    // loop over white pieces bitboards
-    for (int piece = P; piece <= K; piece++)
-        // populate white occupancy bitboard
-        occupancies[white] |= bitboards[piece];
-
-    // loop over black pieces bitboards
-    for (int piece = p; piece <= k; piece++)
-        // populate white occupancy bitboard
-        occupancies[black] |= bitboards[piece];
-
-
-    // init all occupancies
-    occupancies[both] |= occupancies[white];
-    occupancies[both] |= occupancies[black];
-}
-
-//Default constructor and destructor
-Skunk::Skunk() {
-    //reset all of our bitboards
-    memset(bitboards, 0ULL, sizeof(bitboards));
-    memset(occupancies, 0ULL, sizeof(occupancies));
     //init all of our saved tables for piece attacks
     construct_pawn_tables();
     construct_knight_masks();
@@ -122,108 +33,10 @@ Skunk::Skunk() {
     construct_rays();
     construct_direction_rays();
     construct_file_masks();
-
-    //reset our turn
-    side = white;
-    //reset our castle rights
-    castle = 0;
-}
-
-void Skunk::init() {
-    seed = 4091583267;//1804289383;
-
-    fill_occupancies();
-
-    repitition.count = 0;
-
-    // intialize zobrist hashing random keys
-    for (int piece=P; piece <= k; piece++) {
-        for (int board = 0; board<64; board++) {
-            piece_keys[piece][board] = get_random_U64_number();
-        }
-    }
-    for (int board=0; board<64; board++) {
-        enpassant_keys[board] = get_random_U64_number();
-    }
-
-    for (int i=0; i<16; i++) {
-        castle_keys[i] = get_random_U64_number();
-    }
-
-    side_key = get_random_U64_number();
-
-    zobrist = generate_zobrist();
-
     init_precomputed_masks();
-    
-    init_heuristics();
-
-}
-
-
-
-// generate 32-bit pseudo legal numbers
-unsigned int Skunk::get_random_U32_number()
-{
-    // get current state
-    unsigned int number = seed;
-
-    // XOR shift algorithm
-    number ^= number << 13;
-    number ^= number >> 17;
-    number ^= number << 5;
-
-    seed = number;
-    // return random number
-    return number;
-}
-
-U64 Skunk::generate_zobrist() {
-
-    U64 hash = 0ULL;
-    U64 bitboard;
-
-    for (int piece = P; piece <=k; piece ++) {
-        bitboard = bitboards[piece];
-        while (bitboard) {
-            int square = __builtin_ctzll(bitboard);
-            hash ^= piece_keys[piece][square];
-            pop_bit(bitboard, square);
-        }
-    }
-
-    if (enpassant != no_square) {
-        hash ^= enpassant_keys[enpassant];
-    }
-
-    hash ^= castle_keys[castle];
-
-    if (side == black) hash ^= side_key;
-
-
-    return hash;
-}
-
-// generate 64-bit pseudo legal numbers
-U64 Skunk::get_random_U64_number()
-{
-    // define 4 random numbers
-    U64 n1, n2, n3, n4;
-
-    // init random numbers slicing 16 bits from MS1B side
-    n1 = (U64)(get_random_U32_number()) & 0xFFFF;
-    n2 = (U64)(get_random_U32_number()) & 0xFFFF;
-    n3 = (U64)(get_random_U32_number()) & 0xFFFF;
-    n4 = (U64)(get_random_U32_number()) & 0xFFFF;
-
-    // return random number
-    return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
-}
-Skunk::~Skunk() {
-
 }
 
-void Skunk::construct_file_masks() {
+void Tables::construct_file_masks() {
 
     memset(file_masks, 0ULL, sizeof(file_masks));
 
@@ -261,7 +74,7 @@ void Skunk::construct_file_masks() {
 
 
 
-void Skunk::construct_direction_rays() {
+void Tables::construct_direction_rays() {
 
     for (int i=0; i<64; i++) {
         // right
@@ -294,7 +107,7 @@ void Skunk::construct_direction_rays() {
 
 }
 // generate rays from source square to destination square for every square
-void Skunk::construct_rays() {
+void Tables::construct_rays() {
     memset(rays, 0ULL, sizeof(rays));
     int count = 0;
     U64 ray = 0ULL;
@@ -353,7 +166,7 @@ void Skunk::construct_rays() {
     }
 }
 
-void Skunk::construct_pawn_tables() {
+void Tables::construct_pawn_tables() {
     //Generate the pawn tables
     for (int square=0; square<64; square++)
     {
@@ -378,7 +191,7 @@ void Skunk::construct_pawn_tables() {
     }
 }
 
-void Skunk::construct_knight_masks() {
+void Tables::construct_knight_masks() {
     //Generate the knight tables
     for (int square=0; square<64; square++) {
         U64 white_board = 0UL;
@@ -405,14 +218,14 @@ void Skunk::construct_knight_masks() {
     }
 }
 
-void Skunk::init_precomputed_masks() {
+void Tables::init_precomputed_masks() {
     for (int square = 0; square < 64; square++) {
         pawn_attack_span_masks[white][square] = pawn_attack_span(white, square);
         pawn_attack_span_masks[black][square] = pawn_attack_span(black, square);
     }
 }
 
-U64 Skunk::pawn_attack_span(int color, int square) {
+U64 Tables::pawn_attack_span(int color, int square) {
     U64 attacks = 0ULL;
 
     // do it just for white
@@ -427,7 +240,7 @@ U64 Skunk::pawn_attack_span(int color, int square) {
     return attacks;
 }
 
-void Skunk::construct_king_tables() {
+void Tables::construct_king_tables() {
     //Generate the kings tables
     for (int square=0; square<64; square++) {
         U64 white_board = 0UL;
@@ -452,7 +265,7 @@ void Skunk::construct_king_tables() {
     }
 }
 
-void Skunk::construct_bishop_tables() {
+void Tables::construct_bishop_tables() {
     //Generate the bishop tables
     for (int square=0; square<64; square++) {
         U64 attacks = 0UL;
@@ -468,7 +281,7 @@ void Skunk::construct_bishop_tables() {
     }
 }
 
-void Skunk::construct_rook_tables() {
+void Tables::construct_rook_tables() {
     //Generate the kings tables
     for (int square=0; square<64; square++) {
         U64 attacks = 0UL;
@@ -484,7 +297,7 @@ void Skunk::construct_rook_tables() {
     }
 }
 
-U64 Skunk::construct_bishop_attacks(int square, unsigned long long int blockers) {
+U64 Tables::construct_bishop_attacks(int square, unsigned long long int blockers) {
     U64 moves = 0UL;
 
     int tr = square >> 3;
@@ -510,7 +323,7 @@ U64 Skunk::construct_bishop_attacks(int square, unsigned long long int blockers)
     return moves;
 }
 
-U64 Skunk::construct_rook_attacks(int square, U64 blockers) {
+U64 Tables::construct_rook_attacks(int square, U64 blockers) {
     //Generate the kings tables
     U64 attacks = 0UL;
 
@@ -536,7 +349,7 @@ U64 Skunk::construct_rook_attacks(int square, U64 blockers) {
     return attacks;
 }
 
-void Skunk::construct_slider_attacks() {
+void Tables::construct_slider_attacks() {
     for (int square=0; square<64; square++)
     {
         // get our rook attack mask
@@ -580,26 +393,206 @@ void Skunk::construct_slider_attacks() {
     }
 }
 
-U64 Skunk::get_rook_attacks(int square, U64 occupancy) {
-    occupancy &= rook_masks[square];
-    occupancy *= rook_magic_numbers[square];
-    occupancy >>= 64 - rook_relevant_bits[square];
-    return rook_attacks[square][occupancy];
+U64 Tables::set_occupancy(int index, int bits_in_mask, U64 attack_mask) {
+    U64 occupancy = 0ULL;
+
+    for (int i=0; i<bits_in_mask; i++)
+    {
+        int square = __builtin_ctzll(attack_mask);
+        pop_bit(attack_mask, square);
+        if (index & (1ULL << i))
+        {
+            occupancy |= 1ULL << square;
+        }
+    }
+    return occupancy;
+}
+
+
+int Tables::coordinate_to_square(const char *coordinate) const {
+    for (int i=0; i<64; i++) {
+        // just bruteforce check which square matches
+        if (strcmp(square_to_coordinate[i], coordinate) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Tables::print_move(int move) const {
+    int promoted = decode_promoted(move);
+    if (promoted) {
+        printf("%s%s%c", square_to_coordinate[decode_source(move)],
+               square_to_coordinate[decode_destination(move)],
+               ascii_pieces[promoted]);
+    }
+
+    else
+        printf("%s%s", square_to_coordinate[decode_source(move)],
+               square_to_coordinate[decode_destination(move)]);
+}
+
+/*****************************\
+===============================
+           position
+===============================
+\*****************************/
+
+void Position::clear() {
+    memset(this, 0, sizeof(Position));
+    memset(mailbox, -1, sizeof(mailbox));
+    side = white;
+    enpassant = no_square;
+}
+
+// a malformed fen leaves the position as it was
+bool Position::parse_fen(const std::string& fen) {
+    Position parsed;
+    if (!parsed.set_position(fen.data(), fen.length())) return false;
+    *this = parsed;
+    return true;
+}
+
+/*
+ * Sets up the position from the piece placement, side, castling and en passant fields of a FEN or EPD record,
+ * walking the raw characters once and building the occupancies and hash key as it goes. Missing trailing fields
+ * default to white to move, no castling and no en passant square. Returns the number of characters consumed
+ * (including any halfmove/fullmove counters) so the caller can find the EPD operations, or 0 if the piece
+ * placement is malformed or does not give each side one king.
+ */
+size_t Position::set_position(const char *fen, size_t length) {
+    // reset bitboards, occupancies, mailbox and game state variables
+    clear();
+
+    const char *cursor = fen;
+    const char *end = fen + length;
+
+    while (cursor < end && *cursor == ' ') cursor++;
+
+    // loop over board squares
+    int square = 0;
+    while (cursor < end && *cursor != ' ') {
+        char c = *cursor++;
+        if (c == '/') {
+            // match rank separator
+            continue;
+        }
+        if (c >= '1' && c <= '8') {
+            // match empty square numbers within FEN string
+            square += c - '0';
+            continue;
+        }
+
+        // match ascii pieces within FEN string
+        int piece = tables.char_pieces[c & 127];
+        if (ascii_pieces[piece] != c || square > 63) return 0;
+
+        set_bit(bitboards[piece], square);
+        mailbox[square] = piece;
+        piece_count[piece]++;
+        zobrist ^= zobrist_keys.piece_keys[piece][square];
+        if (piece == P || piece == p) pawn_key ^= zobrist_keys.piece_keys[piece][square];
+        square++;
+    }
+    if (square != 64) return 0;
+
+    // the search and the move generator both assume exactly one king a side
+    if (piece_count[K] != 1 || piece_count[k] != 1) return 0;
+
+    // parse side to move
+    while (cursor < end && *cursor == ' ') cursor++;
+    if (cursor < end) {
+        side = (*cursor++ == 'b') ? black : white;
+    }
+
+    // parse castling rights
+    while (cursor < end && *cursor == ' ') cursor++;
+    while (cursor < end && *cursor != ' ') {
+        switch (*cursor++) {
+            case 'K': castle |= wk; break;
+            case 'Q': castle |= wq; break;
+            case 'k': castle |= bk; break;
+            case 'q': castle |= bq; break;
+        }
+    }
+
+    // parse enpassant square
+    while (cursor < end && *cursor == ' ') cursor++;
+    if (cursor + 1 < end && cursor[0] >= 'a' && cursor[0] <= 'h' && cursor[1] >= '1' && cursor[1] <= '8') {
+        int file = cursor[0] - 'a';
+        int rank = 8 - (cursor[1] - '0');
+        enpassant = rank * 8 + file;
+        zobrist ^= zobrist_keys.enpassant_keys[enpassant];
+    }
+    while (cursor < end && *cursor != ' ') cursor++;
+
+    // skip the halfmove and fullmove counters of a FEN, which are not tracked
+    for (int counter = 0; counter < 2; counter++) {
+        const char *field = cursor;
+        while (field < end && *field == ' ') field++;
+        if (field == end || *field < '0' || *field > '9') break;
+        while (field < end && *field >= '0' && *field <= '9') field++;
+        cursor = field;
+    }
+
+    // update occupancies
+    occupancies[white] = bitboards[P] | bitboards[N] | bitboards[B] | bitboards[R] | bitboards[Q] | bitboards[K];
+    occupancies[black] = bitboards[p] | bitboards[n] | bitboards[b] | bitboards[r] | bitboards[q] | bitboards[k];
+    occupancies[both] = occupancies[white] | occupancies[black];
+
+    // finish the hash key
+    zobrist ^= zobrist_keys.castle_keys[castle];
+    if (side == black) zobrist ^= zobrist_keys.side_key;
+
+    return cursor - fen;
 }
 
-U64 Skunk::get_bishop_attacks(int square, U64 occupancy) {
-    occupancy &= bishop_masks[square];
-    occupancy *= bishop_magic_numbers[square];
-    occupancy >>= 64 - bishop_relevant_bits[square];
-    return bishop_attacks[square][occupancy];
+
+void Position::fill_occupancies() {
+    // loop over white pieces bitboards
+    for (int piece = P; piece <= K; piece++)
+        // populate white occupancy bitboard
+        occupancies[white] |= bitboards[piece];
+
+    // loop over black pieces bitboards
+    for (int piece = p; piece <= k; piece++)
+        // populate white occupancy bitboard
+        occupancies[black] |= bitboards[piece];
+
+
+    // init all occupancies
+    occupancies[both] |= occupancies[white];
+    occupancies[both] |= occupancies[black];
 }
 
-U64 Skunk::get_queen_attacks(int square, U64 occupancy) {
-    return get_rook_attacks(square, occupancy) | get_bishop_attacks(square, occupancy);
+U64 Position::generate_zobrist() const {
+
+    U64 hash = 0ULL;
+    U64 bitboard;
+
+    for (int piece = P; piece <=k; piece ++) {
+        bitboard = bitboards[piece];
+        while (bitboard) {
+            int square = __builtin_ctzll(bitboard);
+            hash ^= zobrist_keys.piece_keys[piece][square];
+            pop_bit(bitboard, square);
+        }
+    }
+
+    if (enpassant != no_square) {
+        hash ^= zobrist_keys.enpassant_keys[enpassant];
+    }
+
+    hash ^= zobrist_keys.castle_keys[castle];
+
+    if (side == black) hash ^= zobrist_keys.side_key;
+
+
+    return hash;
 }
 
 // is square current given attacked by the current given side
-bool Skunk::is_square_attacked(int square, int side)
+bool Position::is_square_attacked(int square, int side) const
 {
 #ifdef DEBUG
     if (side != 0 && side != 1) {
@@ -611,25 +604,25 @@ bool Skunk::is_square_attacked(int square, int side)
 #endif
 
     // attacked by white pawns
-    if ((side == white) && (pawn_masks[black][square] & bitboards[P])) return true;
+    if ((side == white) && (tables.pawn_masks[black][square] & bitboards[P])) return true;
 
     // attacked by black pawns
-    if ((side == black) && (pawn_masks[white][square] & bitboards[p])) return true;
+    if ((side == black) && (tables.pawn_masks[white][square] & bitboards[p])) return true;
 
     // attacked by knights
-    if (knight_masks[square] & ((side == white) ? bitboards[N] : bitboards[n])) return true;
+    if (tables.knight_masks[square] & ((side == white) ? bitboards[N] : bitboards[n])) return true;
 
     // attacked by bishops
-    if (get_bishop_attacks(square, occupancies[both]) & ((side == white) ? bitboards[B] : bitboards[b])) return true;
+    if (tables.get_bishop_attacks(square, occupancies[both]) & ((side == white) ? bitboards[B] : bitboards[b])) return true;
 
     // attacked by rooks
-    if (get_rook_attacks(square, occupancies[both]) & ((side == white) ? bitboards[R] : bitboards[r])) return true;
+    if (tables.get_rook_attacks(square, occupancies[both]) & ((side == white) ? bitboards[R] : bitboards[r])) return true;
 
     // attacked by bishops
-    if (get_queen_attacks(square, occupancies[both]) & ((side == white) ? bitboards[Q] : bitboards[q])) return true;
+    if (tables.get_queen_attacks(square, occupancies[both]) & ((side == white) ? bitboards[Q] : bitboards[q])) return true;
 
     // attacked by kings
-    if (king_masks[square] & ((side == white) ? bitboards[K] : bitboards[k])) return true;
+    if (tables.king_masks[square] & ((side == white) ? bitboards[K] : bitboards[k])) return true;
 
     // by default return false
     return false;
@@ -643,7 +636,7 @@ bool Skunk::is_square_attacked(int square, int side)
 
 
 //Prints out the given board
-void Skunk::print_bitboard(U64 board) {
+void Position::print_bitboard(U64 board) const {
     for (int i=0; i<64; i++)
     {
         if ((i & 7) == 0) {
@@ -658,7 +651,7 @@ void Skunk::print_bitboard(U64 board) {
 }
 
 //Prints out the attacks for a side
-void Skunk::print_attacks(int side) {
+void Position::print_attacks(int side) const {
     for (int i=0; i<64; i++)
     {
         if ((i & 7) == 0) {
@@ -671,7 +664,36 @@ void Skunk::print_attacks(int side) {
     std::cout << "\n\n\t\ta  b  c  d  e  f  g  h" << std::endl;
 }
 
-void Skunk::print_board() {
+// times the set-wise slider attack kernel against the per-piece magic lookups on this position
+void Position::bench_slider_attacks(int iterations) const {
+    U64 sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        // keep the compiler from hoisting the lookup out of the loop
+        asm volatile("" ::: "memory");
+        sink ^= get_slider_attacks_magic() + i;
+    }
+    auto magic_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        // keep the compiler from hoisting the lookup out of the loop
+        asm volatile("" ::: "memory");
+        sink ^= get_slider_attacks() + i;
+    }
+    auto set_wise_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    printf("magic: %.2f ns/call\n", (double)magic_ns / iterations);
+#ifdef __AVX2__
+    printf("kogge-stone avx2: %.2f ns/call\n", (double)set_wise_ns / iterations);
+#else
+    printf("kogge-stone avx2: not compiled in (%.2f ns/call)\n", (double)set_wise_ns / iterations);
+#endif
+    printf("results %s (%llx)\n", get_slider_attacks() == get_slider_attacks_magic() ? "match" : "DIFFER", sink);
+}
+
+void Position::print_board() {
     std::cout << std::endl;
     //loop over rank and files
     for (int rank = 0; rank<8; rank++)
@@ -699,7 +721,7 @@ void Skunk::print_board() {
             #ifdef _WIN32
                         printf(" %c", (piece == -1) ? '.' : ascii_pieces[piece]);
             #else
-                        printf(" %s ", (piece == -1) ? "." : unicode_pieces[piece]);
+                        printf(" %s ", (piece == -1) ? "." : tables.unicode_pieces[piece]);
             #endif
         }
         // print a newline
@@ -710,56 +732,78 @@ void Skunk::print_board() {
     // print whos turn it is
     std::cout << "\nSide: " << (side == white ? "white" : "black") << std::endl;
     // print en passant square
-    printf("Enpassant: %s\n", enpassant==no_square?"None":square_to_coordinate[enpassant]);
+    printf("Enpassant: %s\n", enpassant==no_square?"None":tables.square_to_coordinate[enpassant]);
     //print castling rights
     std::cout << "\nCastling: " << ((castle&wk) ? 'K':'-') << ((castle&wq)?'Q':'-') << ((castle&bk)?'k':'-') << ((castle&bq)?'q':'-') << std::endl;
 
     printf("Positional score: %f\n", evaluate());
-
-    printf("Ply: %d\n", ply);
 }
 
 /*****************************\
 ===============================
-        bit helpers
+        move generation
 ===============================
 \*****************************/
 
-
-int Skunk::bit_count(U64 board) {
-    int count = 0;
-    while (board)
-    {
-        count ++;
-        board &= board - 1;
-    }
-    return count;
+#ifdef __AVX2__
+/*
+ * Kogge-Stone occluded fill for every slider of one side at once. The eight ray directions are split over two
+ * 256-bit vectors, one lane per direction: east, south, south east and south west move towards higher square
+ * indices (left shifts by 1, 8, 9 and 7) and west, north, north west and north east towards lower ones (right
+ * shifts by the same amounts). Orthogonal sliders fill the first two lanes and diagonal sliders the last two.
+ * The wrap masks stop a ray from leaving the a or h file and reappearing on the other side of the board.
+ */
+U64 kogge_stone_slider_attacks(U64 orthogonal, U64 diagonal, U64 empty) {
+    const __m256i shift1 = _mm256_setr_epi64x(1, 8, 9, 7);
+    const __m256i shift2 = _mm256_slli_epi64(shift1, 1);
+    const __m256i shift4 = _mm256_slli_epi64(shift1, 2);
+    const __m256i wrap_up = _mm256_setr_epi64x((long long)not_a_file, -1LL, (long long)not_a_file, (long long)not_h_file);
+    const __m256i wrap_down = _mm256_setr_epi64x((long long)not_h_file, -1LL, (long long)not_h_file, (long long)not_a_file);
+
+    __m256i gen_up = _mm256_setr_epi64x((long long)orthogonal, (long long)orthogonal, (long long)diagonal, (long long)diagonal);
+    __m256i gen_down = gen_up;
+    __m256i pro_up = _mm256_and_si256(_mm256_set1_epi64x((long long)empty), wrap_up);
+    __m256i pro_down = _mm256_and_si256(_mm256_set1_epi64x((long long)empty), wrap_down);
+
+    // fill 1, 2 and then 4 steps along each ray through empty squares
+    gen_up = _mm256_or_si256(gen_up, _mm256_and_si256(pro_up, _mm256_sllv_epi64(gen_up, shift1)));
+    gen_down = _mm256_or_si256(gen_down, _mm256_and_si256(pro_down, _mm256_srlv_epi64(gen_down, shift1)));
+    pro_up = _mm256_and_si256(pro_up, _mm256_sllv_epi64(pro_up, shift1));
+    pro_down = _mm256_and_si256(pro_down, _mm256_srlv_epi64(pro_down, shift1));
+
+    gen_up = _mm256_or_si256(gen_up, _mm256_and_si256(pro_up, _mm256_sllv_epi64(gen_up, shift2)));
+    gen_down = _mm256_or_si256(gen_down, _mm256_and_si256(pro_down, _mm256_srlv_epi64(gen_down, shift2)));
+    pro_up = _mm256_and_si256(pro_up, _mm256_sllv_epi64(pro_up, shift2));
+    pro_down = _mm256_and_si256(pro_down, _mm256_srlv_epi64(pro_down, shift2));
+
+    gen_up = _mm256_or_si256(gen_up, _mm256_and_si256(pro_up, _mm256_sllv_epi64(gen_up, shift4)));
+    gen_down = _mm256_or_si256(gen_down, _mm256_and_si256(pro_down, _mm256_srlv_epi64(gen_down, shift4)));
+
+    // one more step onto the blocker (or the edge of the board) turns the fill into attacks
+    __m256i attacks = _mm256_or_si256(
+            _mm256_and_si256(_mm256_sllv_epi64(gen_up, shift1), wrap_up),
+            _mm256_and_si256(_mm256_srlv_epi64(gen_down, shift1), wrap_down));
+
+    __m128i half = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+    return (U64)_mm_cvtsi128_si64(half) | (U64)_mm_extract_epi64(half, 1);
 }
+#endif
 
 
-U64 Skunk::set_occupancy(int index, int bits_in_mask, U64 attack_mask) {
-    U64 occupancy = 0ULL;
 
-    for (int i=0; i<bits_in_mask; i++)
-    {
-        int square = __builtin_ctzll(attack_mask);
-        pop_bit(attack_mask, square);
-        if (index & (1ULL << i))
-        {
-            occupancy |= 1ULL << square;
-        }
-    }
-    return occupancy;
+// union of every square attacked by the opponent's bishops, rooks and queens
+U64 Position::get_slider_attacks() const {
+#ifdef __AVX2__
+    U64 orthogonal = side == white ? bitboards[r] | bitboards[q] : bitboards[R] | bitboards[Q];
+    U64 diagonal = side == white ? bitboards[b] | bitboards[q] : bitboards[B] | bitboards[Q];
+    return kogge_stone_slider_attacks(orthogonal, diagonal, ~occupancies[both]);
+#else
+    return get_slider_attacks_magic();
+#endif
 }
 
-
-/*****************************\
-===============================
-        move generation
-===============================
-\*****************************/
-
-U64 Skunk::get_slider_attacks() {
+// same union built one piece at a time from the magic tables
+U64 Position::get_slider_attacks_magic() const {
     U64 pieces;
     U64 sliders = 0ULL;
     int knight=N, bishop=B, rook=R, queen=Q;
@@ -769,28 +813,28 @@ U64 Skunk::get_slider_attacks() {
 
     pieces = bitboards[bishop];
     while (pieces) {
-        sliders |= get_bishop_attacks(__builtin_ctzll(pieces), occupancies[both]);
+        sliders |= tables.get_bishop_attacks(__builtin_ctzll(pieces), occupancies[both]);
         pop_lsb(pieces);
     }
 
     pieces = bitboards[rook];
     while (pieces) {
-        sliders |= get_rook_attacks(__builtin_ctzll(pieces), occupancies[both]);
+        sliders |= tables.get_rook_attacks(__builtin_ctzll(pieces), occupancies[both]);
         pop_lsb(pieces);
     }
 
     // calculate queen attacks
     pieces = bitboards[queen];
     while (pieces) {
-        sliders |= get_rook_attacks(__builtin_ctzll(pieces), occupancies[both]);
-        sliders |= get_bishop_attacks(__builtin_ctzll(pieces), occupancies[both]);
+        sliders |= tables.get_rook_attacks(__builtin_ctzll(pieces), occupancies[both]);
+        sliders |= tables.get_bishop_attacks(__builtin_ctzll(pieces), occupancies[both]);
         pop_lsb(pieces);
     }
 
     return sliders;
 }
 
-U64 Skunk::get_jumper_attacks() {
+U64 Position::get_jumper_attacks() const {
     U64 pieces;
     U64 jumpers = 0ULL;
     int pawn = P, knight=N, king=K;
@@ -801,21 +845,21 @@ U64 Skunk::get_jumper_attacks() {
     // calculate white pawn attacks
     pieces = bitboards[pawn];
     while (pieces) {
-        jumpers |= pawn_masks[side^1][__builtin_ctzll(pieces)];
+        jumpers |= tables.pawn_masks[side^1][__builtin_ctzll(pieces)];
         pop_lsb(pieces);
     }
 
     // calculate knight attacks
     pieces = bitboards[knight];
     while (pieces) {
-        jumpers |= knight_masks[__builtin_ctzll(pieces)];
+        jumpers |= tables.knight_masks[__builtin_ctzll(pieces)];
         pop_lsb(pieces);
     }
 
     //calculate king attacks
     pieces = bitboards[king];
     while (pieces) {
-        jumpers |= king_masks[__builtin_ctzll(pieces)];
+        jumpers |= tables.king_masks[__builtin_ctzll(pieces)];
         pop_lsb(pieces);
     }
     return jumpers;
@@ -824,7 +868,7 @@ U64 Skunk::get_jumper_attacks() {
 
 
 // generate all t_moves
-void Skunk::generate_moves(t_moves &moves_list)
+void Position::generate_moves(t_moves &moves_list)
 {
     // the goal of this move generator is to use the least branching possible, even at the cost of calculation
 
@@ -866,7 +910,7 @@ void Skunk::generate_moves(t_moves &moves_list)
     attacked_squares = attack_jumpers | attack_sliders;
     set_bit(occupancies[both], king_square);
 
-    pieces = king_masks[__builtin_ctzll(bitboards[king])] & ~occupancies[side] & ~attacked_squares;
+    pieces = tables.king_masks[__builtin_ctzll(bitboards[king])] & ~occupancies[side] & ~attacked_squares;
     // get all of the destinations for the king
     while (pieces) {
         square = __builtin_ctzll(pieces);
@@ -894,20 +938,20 @@ void Skunk::generate_moves(t_moves &moves_list)
 
     // get a bitboard with all attackers that have king in check on them
     // do pawn first
-    capture_mask |= get_bishop_attacks(king_square, occupancies[both]) & (opponent_bitboards[B] | opponent_bitboards[Q]);
-    capture_mask |= get_rook_attacks(king_square, occupancies[both]) & (opponent_bitboards[R] | opponent_bitboards[Q]);
+    capture_mask |= tables.get_bishop_attacks(king_square, occupancies[both]) & (opponent_bitboards[B] | opponent_bitboards[Q]);
+    capture_mask |= tables.get_rook_attacks(king_square, occupancies[both]) & (opponent_bitboards[R] | opponent_bitboards[Q]);
 
     // here we have our slider pieces, we can use these to fill our push mask before adding other pieces
     U64 sliders = capture_mask;
     while (sliders) {
         square = __builtin_ctzll(sliders);
-        push_mask |= rays[square][king_square];
+        push_mask |= tables.rays[square][king_square];
         pop_lsb(sliders);
     }
 
 
-    capture_mask |= knight_masks[king_square] & opponent_bitboards[N];
-    capture_mask |= pawn_masks[side][king_square] & opponent_bitboards[P];
+    capture_mask |= tables.knight_masks[king_square] & opponent_bitboards[N];
+    capture_mask |= tables.pawn_masks[side][king_square] & opponent_bitboards[P];
 
 
     // if no pieces are checking the king, then any move on the board is a valid move and we do not check for early escape
@@ -936,13 +980,13 @@ void Skunk::generate_moves(t_moves &moves_list)
     memcpy(unpinned_pieces, bitboards, 12 * sizeof(U64));
 
     // make king a slider piece, and detect intersection with opponent sliding enemy_attacks. Then, any piece on those intersections is pinned
-    U64 slider_king = get_bishop_attacks(king_square, occupancies[both]) | get_rook_attacks(king_square, occupancies[both]);
+    U64 slider_king = tables.get_bishop_attacks(king_square, occupancies[both]) | tables.get_rook_attacks(king_square, occupancies[both]);
     int pinner_pieces[] = {R, B, Q};
     int pinner_piece, enemy_square, pinned_square, piece, destination;
     // calculate the moves for each piece in each direction
     for (int direction=0; direction<8; direction++) {
         // get the king ray in the opposite direction
-        U64 king_ray = slider_king & rays[king_square][nearest_square[7 - direction][king_square]];
+        U64 king_ray = slider_king & tables.rays[king_square][tables.nearest_square[7 - direction][king_square]];
 
         // check pins by each type of piece
         for (int piece_index = 0; piece_index<3; piece_index++) {
@@ -958,9 +1002,9 @@ void Skunk::generate_moves(t_moves &moves_list)
                 // which type of piece is it? Shoot, we need to know this to generate its attacks
                 U64 intersection = get_attacks(pinner_piece, enemy_square, side ^ 1);
 
-                int nearest_sq = nearest_square[direction][enemy_square];
+                int nearest_sq = tables.nearest_square[direction][enemy_square];
 
-                intersection  &= rays[enemy_square][nearest_sq];
+                intersection  &= tables.rays[enemy_square][nearest_sq];
                 intersection &= king_ray;
                 intersection &= occupancies[side];
                 // if there is no pinned piece, do not try and pop a bit off...just return early here (happens more often than not)
@@ -975,7 +1019,7 @@ void Skunk::generate_moves(t_moves &moves_list)
 
                 pop_bit(unpinned_pieces[piece], pinned_square);
 //                 we are only able to move on the ray between king and enemy piece, and must move so that it can block check
-                U64 attacks = get_attacks(piece, pinned_square, side) & (rays[king_square][enemy_square] | (1ULL << enemy_square)) & (push_mask | capture_mask);
+                U64 attacks = get_attacks(piece, pinned_square, side) & (tables.rays[king_square][enemy_square] | (1ULL << enemy_square)) & (push_mask | capture_mask);
 
 //              go through each valid attack and add it to the list of moves
                 while (attacks) {
@@ -1032,9 +1076,9 @@ void Skunk::generate_moves(t_moves &moves_list)
                 // include any pinned pieces in this check
 
                 // check each queen
-                int lsq = nearest_square[DW][king_square], rsq=nearest_square[DE][king_square], usq = nearest_square[DN][king_square], dsq=nearest_square[DS][king_square];
-                U64 horizontal_mask = rays[king_square][lsq] | rays[king_square][rsq] | rays[king_square][usq] | rays[king_square][dsq] | (1ULL << lsq) | (1ULL << rsq) | (1ULL << usq) | (1ULL << dsq) | (1ULL << king_square);
-                U64 king_possible_pin_masks = get_queen_attacks(king_square, occupancies[both]) | (1ULL << king_square);//(rays[king_square][lsq] | rays[king_square][rsq] | rays[king_square][usq] | rays[king_square][dsq] | (1ULL << lsq) | (1ULL << rsq) | (1ULL << usq) | (1ULL << dsq) | (1ULL << king_square));
+                int lsq = tables.nearest_square[DW][king_square], rsq=tables.nearest_square[DE][king_square], usq = tables.nearest_square[DN][king_square], dsq=tables.nearest_square[DS][king_square];
+                U64 horizontal_mask = tables.rays[king_square][lsq] | tables.rays[king_square][rsq] | tables.rays[king_square][usq] | tables.rays[king_square][dsq] | (1ULL << lsq) | (1ULL << rsq) | (1ULL << usq) | (1ULL << dsq) | (1ULL << king_square);
+                U64 king_possible_pin_masks = tables.get_queen_attacks(king_square, occupancies[both]) | (1ULL << king_square);//(tables.rays[king_square][lsq] | tables.rays[king_square][rsq] | tables.rays[king_square][usq] | tables.rays[king_square][dsq] | (1ULL << lsq) | (1ULL << rsq) | (1ULL << usq) | (1ULL << dsq) | (1ULL << king_square));
                 
 
                 U64 horizontal_attackers = (opponent_bitboards[R] | opponent_bitboards[Q]) & (king_possible_pin_masks & horizontal_mask);
@@ -1049,14 +1093,14 @@ void Skunk::generate_moves(t_moves &moves_list)
                 // check if king is in attack after any enpassant moves from horizontal pieces
                 while (horizontal_attackers) {
                     int horizontal_attacker_square = __builtin_ctzll(horizontal_attackers);
-                    sliders |= get_rook_attacks(horizontal_attacker_square, occupancies[both]);
+                    sliders |= tables.get_rook_attacks(horizontal_attacker_square, occupancies[both]);
                     pop_lsb(horizontal_attackers);
                 }
 
                 // check if king is in attack after any enpassant moves from diagonal pieces
                 while (diagonal_attackers) {
                     int diagonal_attacker_square = __builtin_ctzll(diagonal_attackers);
-                    diagonals |= get_bishop_attacks(diagonal_attacker_square, occupancies[both]);
+                    diagonals |= tables.get_bishop_attacks(diagonal_attacker_square, occupancies[both]);
                     pop_lsb(diagonal_attackers);
                 }
                 // print_bitboard(diagonals);
@@ -1082,688 +1126,177 @@ void Skunk::generate_moves(t_moves &moves_list)
             moves_list.moves[moves_list.count++] = encode_move(square, destination, pawn, rook, 0, 0);
             moves_list.moves[moves_list.count++] = encode_move(square, destination, pawn, bishop, 0, 0);
             moves_list.moves[moves_list.count++] = encode_move(square, destination, pawn, queen, 0, 0);
-            moves_list.moves[moves_list.count++] = encode_move(square, destination, pawn, knight, 0, 0);
-
-            pop_lsb(filtered);
-        }
-        pop_lsb(pieces);
-    }
-
-    // do rook, queen, bishop, and knight moves
-    int regular_pieces[] = {rook, queen, bishop, knight};
-    for (int i=0; i<4; i++) {
-        piece = regular_pieces[i];
-        pieces = unpinned_pieces[piece];
-
-        while (pieces) {
-            square = __builtin_ctzll(pieces);
-            attacks = get_attacks(piece, square, side) & (capture_mask | push_mask);
-            while (attacks) {
-                destination = __builtin_ctzll(attacks);
-
-                moves_list.moves[moves_list.count++] = encode_move(square, destination, piece, 0, 0, 0);
-                pop_lsb(attacks);
-            }
-            pop_lsb(pieces);
-        }
-    }
-
-    /******************************************\
-     *
-     *             CASTLING MOVES
-     *
-    \******************************************/
-    if (side == white && (attacked_squares & bitboards[K]) == 0) {
-        // if castling is available and king is not in check
-        if (castle & wk && ((attacked_squares | occupancies[both]) & castle_mask_wk) == 0) {
-            moves_list.moves[moves_list.count++] = encode_move(e1, g1, K, 0, 0, 1);
-            moves_list.contains_castle = 1;
-        }
-
-        if (castle & wq && (attacked_squares & castle_attack_mask_wq) ==0 && (occupancies[both] & castle_piece_mask_wq) == 0 ) {
-            moves_list.moves[moves_list.count++] = encode_move(e1, c1, K, 0, 0, 1);
-            moves_list.contains_castle = 1;
-        }
-    } else if (side == black && (attacked_squares & bitboards[k]) == 0) {
-        if (castle & bk && ((attacked_squares | occupancies[both]) & castle_mask_bk) == 0) {
-            moves_list.moves[moves_list.count++] = encode_move(e8, g8, k, 0, 0, 1);
-            moves_list.contains_castle = 1;
-        }
-
-        if (castle & bq && (attacked_squares & castle_attack_mask_bq) ==0 && (occupancies[both] & castle_piece_mask_bq) == 0 ) {
-            moves_list.moves[moves_list.count++] = encode_move(e8, c8, k, 0, 0, 1);
-            moves_list.contains_castle = 1;
-        }
-    }
-}
-
-int Skunk::get_piece(int square) {
-    int type = -1;
-    U64 mask = (1ULL << square);
-    for (int piece=P; piece<=k; piece++) {
-        if (bitboards[piece] & mask) {
-            type = piece;
-            break;
-        }
-    }
-    return type;
-}
-
-U64 Skunk::get_attacks(int piece, int square, int side) {
-    // go through all of the bitboards and check which piece is on the piece, assuming it is not an invalid piece
-    U64 attacks = 0ULL;
-    U64 piece_bitboard = (1ULL << square);
-
-    switch (piece) {
-        case r:
-        case R:
-            return get_rook_attacks(square, occupancies[both]) & ~occupancies[side];
-        case b:
-        case B:
-            return get_bishop_attacks(square, occupancies[both]) & ~occupancies[side];
-        case q:
-        case Q:
-            return (get_bishop_attacks(square, occupancies[both]) | get_rook_attacks(square, occupancies[both])) & ~occupancies[side];
-        case p:
-//             single pushes
-            attacks |= ((piece_bitboard << 8) & ~occupancies[both]) | (pawn_masks[side][square] & occupancies[side ^ 1]);
-//             double pushes
-            attacks |= ((((piece_bitboard & row7) << 8) & ~occupancies[both]) << 8) & ~occupancies[both];
-            // handle enpassants here as well
-            if (enpassant != no_square) {
-                attacks |= pawn_masks[side][square] & (1ULL << enpassant);
-            }
-            return attacks;
-        case P:
-            // single pushes
-            attacks |= ((piece_bitboard >> 8) & ~occupancies[both]) | (pawn_masks[side][square] & occupancies[side ^ 1]);
-            // double pushes
-            attacks |= ((((piece_bitboard & row2) >> 8) & ~occupancies[both]) >> 8) & ~occupancies[both];
-
-            // handle enpassants here as well
-            if (enpassant != no_square) {
-                // check if enpassant square and capture mask collide
-                attacks |= pawn_masks[side][square] & (1ULL << enpassant);
-            }
-            return attacks;
-        case n:
-        case N:
-            return knight_masks[square] & ~occupancies[side];
-        case k:
-        case K:
-            return king_masks[square] & ~occupancies[side];
-    }
-    return attacks;
-}
-
-void Skunk::add_move(t_moves &moves_list, int move) {
-    // check if it is a legal move
-    moves_list.moves[moves_list.count] = move;
-    moves_list.count++;
-}
-
-void Skunk::print_moves(t_moves &moves_list)
-{
-    printf("%-9s %-6s %-8s %-7s %-9s %-9s %-9s\n","num", "source", "target", "piece", "score", "enpassant", "castle");
-
-    for (int i=0; i<moves_list.count; i++)
-    {
-        int move = moves_list.moves[i];
-        printf("%-9d %-6s %-8s %-7c %-9d %-9d %-9d\n",
-               move,
-               square_to_coordinate[decode_source(move)],
-               square_to_coordinate[decode_destination(move)],
-               ascii_pieces[decode_piece(move)],
-               score_move(move),
-               decode_enpassant(move),
-               decode_castle(move)
-               );
-    }
-    printf("Total of %d moves.\n", moves_list.count);
-}
-
-void Skunk::init_heuristics() {
-    // Initialize killer moves and history table to zero
-    for (int i = 0; i < MAX_PLY; ++i) {
-        killer_moves[i][0] = -1;
-        killer_moves[i][1] = -1;
-    }
-    for (int piece = P; piece <= k; ++piece) {
-        for (int square = 0; square < 64; ++square) {
-            history_table[piece][square] = 0;
-        }
-    }
-}
-
-// Update the killer moves and history table
-void Skunk::update_heuristics(int ply, int move, int depth) {
-    // Update killer moves
-    if (move != killer_moves[ply][0]) {
-        killer_moves[ply][1] = killer_moves[ply][0];
-        killer_moves[ply][0] = move;
-    }
-
-    // Update history table
-    int piece = decode_piece(move);
-    int destination = decode_destination(move);
-    history_table[piece][destination] += depth * depth;
-}
-
-void Skunk::sort_moves(int *moves, int num_moves) {
-
-    std::sort(moves, moves + num_moves, [&](const int &a, const int &b) {
-
-        int a_score = score_move(a);
-        int b_score = score_move(b);
-
-        return a_score > b_score;
-    });
-}
-
-int Skunk::see(int move) {
-    int from = decode_source(move);
-    int to = decode_destination(move);
-    int attacked_piece = get_piece(from);
-    int attacked_value = piece_scores[attacked_piece];
-    int victim = get_piece(to);
-    int victim_value = piece_scores[victim];
-
-    // If the move is not a capture or the captured piece is more valuable, no need to perform SEE
-    if (victim_value == 0 || attacked_value <= victim_value) {
-        return victim_value - attacked_value;
-    }
-
-    // Temporary board to perform SEE calculation
-    copy_board();
-
-    // Perform the capture
-    make_move(move, all_moves);
-
-    // Recursively calculate the SEE value
-    int see_value = victim_value - see(get_smallest_attacker(to));
-
-    // Restore the original board
-    restore_board();
-
-    return see_value;
-}
-
-int Skunk::get_smallest_attacker(int to) {
-    // This function returns the move of the smallest attacker to the square 'to'
-    // Generate all moves for the opponent's pieces
-    t_moves moves_list;
-    moves_list.count = -1;
-    generate_moves(moves_list);
-
-    int smallest_attacker_value = INT_MAX;
-    int smallest_attacker_move = 0;
-
-    for (int i = 0; i < moves_list.count; i++) {
-        int move = moves_list.moves[i];
-
-        // Check if the move is a capture and the destination is the target square
-        if (is_capture(move) && decode_destination(move) == to) {
-            int attacker_piece = get_piece(decode_source(move));
-            int attacker_value = piece_scores[attacker_piece];
-
-            // Update the smallest attacker if the current attacker has a lower value
-            if (attacker_value < smallest_attacker_value) {
-                smallest_attacker_value = attacker_value;
-                smallest_attacker_move = move;
-            }
-        }
-    }
-
-    // If there is no attacker, return 0
-    if (smallest_attacker_value == INT_MAX) {
-        return 0;
-    }
-
-    return smallest_attacker_move;
-}
-
-
-int Skunk::score_move(int move) {
-
-    int score = 0;
-
-    // look for move in previous pv line
-    for (int i = 0; i < previous_pv_line.cmove; ++i) {
-        if (move == previous_pv_line.argmove[i]) {
-            score += 20000 - (i * 100);
-        }
-    }
-   
-    // consult the lookup table
-    int piece = decode_piece(move);
-    int destination = decode_destination(move);
-    int victim = get_piece(destination);
-    
-    if (decode_promoted(move)) {
-        // we want to check promotions high as well
-        score += 5000;
-    }
-
-    // if it is a capture, use a piece victim lookup table
-    // if (is_capture(move)) {
-    //     score += mvv_lva[piece][victim] * 100;
-    // } 
-
-    // if it is a capture, use a piece victim lookup table
-    if (is_capture(move)) {
-        score += mvv_lva[piece][victim] * 100;
-        // Adjust capture score based on SEE value
-        int see_value = see(move);
-        score += see_value * 10;
-    }
-
-#ifdef KILLER_HISTORY
-    // Killer moves
-    if (move == killer_moves[ply][0]) {
-        score += 9000;
-    } else if (move == killer_moves[ply][1]) {
-        score += 8000;
-    }
-
-    // History heuristic
-    score += history_table[piece][decode_destination(move)];
-#endif
-
-    return score;
-}
-
-bool Skunk::is_check() {
-    return is_square_attacked(__builtin_ctzll(bitboards[side==white?K:k]), side^1);
-}
-
-
-int Skunk::quiesence(int alpha, int beta) {
-    q_nodes++;
-    if (force_stop) return 0;
-
-    // Communicate with the user interface periodically
-    if ((nodes % time_check_node_interval) == 0) {
-        communicate();
-    }
-
-    // Generate all legal moves
-    t_moves moves_list;
-    generate_moves(moves_list);
-
-    // Check if the king is in check
-    int check = is_check();
-
-    // Calculate the evaluation score
-    int evaluation = evaluate();// + static_cast<int>(log(moves_list.count + 1) * 0.5 * MOBILITY_WEIGHT) - (check ? KING_SAFETY_WEIGHT : 0);
-    
-
-    // Alpha-beta pruning
-    if (evaluation >= beta) {
-        return evaluation;
-    }
-
-    if (evaluation > alpha) {
-        alpha = evaluation;
-    }
-
-    // Sort the moves to improve search efficiency
-    sort_moves(moves_list.moves, moves_list.count);
-
-    int score = INT_MIN;
-
-    bool made_capture = false;
-
-    for (int i = 0; i < moves_list.count; i++) {
-        int move = moves_list.moves[i];
-
-        // Only consider capture moves in quiescence search
-        if (!is_capture(move)) continue;
-
-        int victim = get_piece(decode_destination(move));
-
-        #ifdef FUTILITY_PRUNE
-        // // Futility pruning: skip moves that are unlikely to improve the position
-        // if (!is_check() && (abs(piece_scores[victim]) + evaluation + piece_scores[Q] * 10) < alpha) {
-        //     return alpha;
-        // }
-        // Futility pruning: skip moves that are unlikely to improve the position
-        int futility_margin = 100; // Adjust this value based on your engine's requirements
-        if (!is_check() && (evaluation + piece_scores[victim] + futility_margin <= alpha)) {
-            continue;
-        }
-        #endif
-
-        
-
-        // Keep track of whether a capture move was made
-        made_capture = true;
-
-        // Copy the board
-        copy_board();
-
-        // Make the move on the board
-        make_move(move, only_captures);
-
-        // Recursively call quiescence search with negamax
-        int test = -quiesence(-beta, -alpha);
-
-        // Update the best score
-        score = std::max(score, test);
-
-        // Restore the board to its previous state
-        restore_board();
-        moves--;
-
-        // Alpha-beta pruning
-        if (score >= beta) {
-            return beta;
-        }
-
-        if (score > alpha) {
-            alpha = score;
-        }
-    }
-
-    // If no legal capture moves and the king is in check, this is a checkmate
-    if (!made_capture && check) {
-        return -CHECKMATE + ply;
-    }
-
-    return alpha;
-}
-
-void Skunk::store_transposition_table(U64 zobristKey, int16_t value, int16_t depth, int move, NodeType type) {
-    TTEntry *entry = &transpositionTable[zobristKey & (HASH_SIZE - 1)];
-    entry->zobristKey = zobristKey;
-    entry->value = value;
-    entry->depth = depth;
-    entry->move = move;
-    entry->type = type;
-}
-
-TTEntry *Skunk::probe_transposition_table(U64 zobristKey) {
-    TTEntry *entry = &transpositionTable[zobristKey & (HASH_SIZE - 1)];
-    if (entry->zobristKey == zobristKey) {
-        return entry;
-    }
-    return nullptr;
-}
-
-bool Skunk::should_do_null_move() {
-    /* should NOT do null move if 
-    the side to move has only its king and pawns remaining
-    the side to move has a small number of pieces remaining
-    the previous move in the search was also a null move.
-    */
-
-    int num_major;
-    // count the number of major pieces
-    if (side == white) {
-        num_major = piece_count[B] + piece_count[R] + piece_count[Q] + piece_count[N];
-    } else {
-        num_major = piece_count[b] + piece_count[r] + piece_count[q] + piece_count[n];
-    }
-
-
-    // side to move has too few of pieces
-    // if (num_major <= 3) return false;
-
-    return true;
-}
-
-// new negamax
-int Skunk::negamax(int alpha, int beta, int depth, int verify, int do_null, t_line *pline) {
-    int best_move = 0, current_move, best_score = -INT_MAX, current_score, null_move_score;
-    bool fail_high = false, check = false;
-    t_line line = {.cmove = 0};
-
-    nodes++;
-
-    if ((nodes % time_check_node_interval) == 0) {
-        communicate();
-    }
-
-    if (force_stop) return 0;
-
-    if (depth < 1) {
-        if (pline != nullptr) pline->cmove = 0;
-        return quiesence(alpha, beta);
-    }
-
-    if (ply && is_repetition()) {
-        return -evaluate() * 0.25;
-    }
-
-    // Transposition table lookup
-    TTEntry *entry = probe_transposition_table(zobrist);
-    if (entry != nullptr && !verify) {
-        if (entry->depth >= depth) {
-            if (entry->type == EXACT) {
-                cache_hit++;
-                if (ply == 0 && pline != nullptr) {
-                    pline->argmove[0] = entry->move;
-                    memcpy(pline->argmove + 1, line.argmove, line.cmove * sizeof(int));
-                    pline->cmove = line.cmove + 1;
-                }
-                return entry->value;
-            } else if (entry->type == LOWER_BOUND) {
-                alpha = std::max(alpha, (entry->value));
-            } else if (entry->type == UPPER_BOUND) {
-                beta = std::min(beta, (entry->value));
-            }
-            if (alpha >= beta) {
-                cache_hit++;
-                return entry->value;
-            }
-        }
-    }
-
-    t_moves moves_list;
-    moves_list.count = -1;
-    generate_moves(moves_list);
-    sort_moves(moves_list.moves, moves_list.count);
-
-    check = is_check();
-
-    if (moves_list.count == 0) {
-        return check ? (-CHECKMATE) + ply : 0;
-    }
-
-    if (check) depth++;
-
-    // Null move pruning
-    if (!check && do_null == DO_NULL && (!verify || depth > 1)) {
-        copy_board();
-        side ^= 1;
-        zobrist ^= side_key;
-        if (enpassant != no_square) {
-            zobrist ^= enpassant_keys[enpassant];
-        }
-        enpassant = no_square;
-
-        ply++;
-
-        null_move_score = -negamax(-beta, -beta + 1, depth - 1 - NULL_R, verify, NO_NULL, nullptr);
-
-        ply--;
-        restore_board();
+            moves_list.moves[moves_list.count++] = encode_move(square, destination, pawn, knight, 0, 0);
 
-        if (null_move_score >= beta) {
-            if (verify) {
-                depth--;
-                verify = false;
-                fail_high = true;
-            } else {
-                return null_move_score;
-            }
+            pop_lsb(filtered);
         }
+        pop_lsb(pieces);
     }
 
-    copy_board();
-    int searched_moves = 0;
+    // do rook, queen, bishop, and knight moves
+    int regular_pieces[] = {rook, queen, bishop, knight};
+    for (int i=0; i<4; i++) {
+        piece = regular_pieces[i];
+        pieces = unpinned_pieces[piece];
 
-    for (int i = 0; i < moves_list.count; i++) {
-        current_move = moves_list.moves[i];
-        make_move(current_move, all_moves);
-        ply++;
-        repitition.table[repitition.count++] = zobrist;
-
-        re_search:
-        // Apply PVS and LMR
-        if (searched_moves == 0) {
-            current_score = -negamax(-beta, -alpha, depth - 1, verify, DO_NULL, &line);
-        } else {
-            if (searched_moves >= LMR_DEPTH && depth >= LMR_MIN_DEPTH && !check && !is_capture(current_move) && decode_promoted(current_move) == 0) {
-                // Apply LMR
-                current_score = -negamax(-alpha - 1, -alpha, depth - 1 - LMR_REDUCTION, verify, NO_NULL, &line);
-
-                if (current_score > alpha && current_score < beta) {
-                    // Re-search with full depth, as the move is better than expected
-                    current_score = -negamax(-beta, -alpha, depth - 1, verify, DO_NULL, &line);
-                }
-            } else {
-                // Apply PVS
-                current_score = -negamax(-alpha - 1, -alpha, depth - 1, verify, NO_NULL, &line);
+        while (pieces) {
+            square = __builtin_ctzll(pieces);
+            attacks = get_attacks(piece, square, side) & (capture_mask | push_mask);
+            while (attacks) {
+                destination = __builtin_ctzll(attacks);
 
-                if (current_score > alpha && current_score < beta) {
-                    // Re-search with full window, as the move is better than expected
-                    current_score = -negamax(-beta, -alpha, depth - 1, verify, DO_NULL, &line);
-                }
+                moves_list.moves[moves_list.count++] = encode_move(square, destination, piece, 0, 0, 0);
+                pop_lsb(attacks);
             }
+            pop_lsb(pieces);
         }
+    }
 
-        // Check for best score and move
-        if (current_score > best_score) {
-            best_score = current_score;
-            best_move = current_move;
+    /******************************************\
+     *
+     *             CASTLING MOVES
+     *
+    \******************************************/
+    if (side == white && (attacked_squares & bitboards[K]) == 0) {
+        // if castling is available and king is not in check
+        if (castle & wk && ((attacked_squares | occupancies[both]) & castle_mask_wk) == 0) {
+            moves_list.moves[moves_list.count++] = encode_move(e1, g1, K, 0, 0, 1);
+            moves_list.contains_castle = 1;
         }
 
-        // Null move verification re-check if no beta cut-off was found
-        if (fail_high && current_score < beta) {
-            depth++;
-            fail_high = false;
-            verify = true;
-            goto re_search;
+        if (castle & wq && (attacked_squares & castle_attack_mask_wq) ==0 && (occupancies[both] & castle_piece_mask_wq) == 0 ) {
+            moves_list.moves[moves_list.count++] = encode_move(e1, c1, K, 0, 0, 1);
+            moves_list.contains_castle = 1;
         }
-
-        restore_board();
-        ply--;
-        repitition.count--;
-        moves--;
-        searched_moves++;
-
-        if (best_score > alpha) {
-            alpha = best_score;
-            if (pline != nullptr) {
-                pline->argmove[0] = current_move;
-                memcpy(pline->argmove + 1, line.argmove, line.cmove * sizeof(int));
-                pline->cmove = line.cmove + 1;
-            }
-
-            if (alpha >= beta) {
-                // Update killer moves and history here...
-                #ifdef KILLER_HISTORY
-                if (!is_capture(current_move) && ply < MAX_PLY) {
-                    update_heuristics(ply, current_move, depth);
-                }
-                #endif
-
-                #ifdef TRANSPOSITION_TABLE
-                store_transposition_table(zobrist, beta, depth, best_move, LOWER_BOUND);
-                #endif
-                return beta;
-            }
+    } else if (side == black && (attacked_squares & bitboards[k]) == 0) {
+        if (castle & bk && ((attacked_squares | occupancies[both]) & castle_mask_bk) == 0) {
+            moves_list.moves[moves_list.count++] = encode_move(e8, g8, k, 0, 0, 1);
+            moves_list.contains_castle = 1;
         }
-    }
 
-    // Transposition table store
-    #ifdef TRANSPOSITION_TABLE
-    NodeType type;
-    if (best_score <= alpha) {
-        type = UPPER_BOUND;
-    } else if (best_score >= beta) {
-        type = LOWER_BOUND;
-    } else {
-        type = EXACT;
+        if (castle & bq && (attacked_squares & castle_attack_mask_bq) ==0 && (occupancies[both] & castle_piece_mask_bq) == 0 ) {
+            moves_list.moves[moves_list.count++] = encode_move(e8, c8, k, 0, 0, 1);
+            moves_list.contains_castle = 1;
+        }
     }
-    store_transposition_table(zobrist, best_score, depth, best_move, type);
-    #endif
-
-    return best_score;
 }
 
+U64 Position::get_attacks(int piece, int square, int side) const {
+    // go through all of the bitboards and check which piece is on the piece, assuming it is not an invalid piece
+    U64 attacks = 0ULL;
+    U64 piece_bitboard = (1ULL << square);
 
+    switch (piece) {
+        case r:
+        case R:
+            return tables.get_rook_attacks(square, occupancies[both]) & ~occupancies[side];
+        case b:
+        case B:
+            return tables.get_bishop_attacks(square, occupancies[both]) & ~occupancies[side];
+        case q:
+        case Q:
+            return (tables.get_bishop_attacks(square, occupancies[both]) | tables.get_rook_attacks(square, occupancies[both])) & ~occupancies[side];
+        case p:
+//             single pushes
+            attacks |= ((piece_bitboard << 8) & ~occupancies[both]) | (tables.pawn_masks[side][square] & occupancies[side ^ 1]);
+//             double pushes
+            attacks |= ((((piece_bitboard & row7) << 8) & ~occupancies[both]) << 8) & ~occupancies[both];
+            // handle enpassants here as well
+            if (enpassant != no_square) {
+                attacks |= tables.pawn_masks[side][square] & (1ULL << enpassant);
+            }
+            return attacks;
+        case P:
+            // single pushes
+            attacks |= ((piece_bitboard >> 8) & ~occupancies[both]) | (tables.pawn_masks[side][square] & occupancies[side ^ 1]);
+            // double pushes
+            attacks |= ((((piece_bitboard & row2) >> 8) & ~occupancies[both]) >> 8) & ~occupancies[both];
 
+            // handle enpassants here as well
+            if (enpassant != no_square) {
+                // check if enpassant square and capture mask collide
+                attacks |= tables.pawn_masks[side][square] & (1ULL << enpassant);
+            }
+            return attacks;
+        case n:
+        case N:
+            return tables.knight_masks[square] & ~occupancies[side];
+        case k:
+        case K:
+            return tables.king_masks[square] & ~occupancies[side];
+    }
+    return attacks;
+}
 
+int Position::see(int move) {
+    int from = decode_source(move);
+    int to = decode_destination(move);
+    int attacked_piece = get_piece(from);
+    int attacked_value = piece_scores[attacked_piece];
+    int victim = get_piece(to);
+    int victim_value = piece_scores[victim];
 
-// the top level call to get the best move
-int Skunk::search(int maxDepth) {
-
-
-    // iterate through deepening as we go
-    t_line pline = {.cmove = 0};
-
-    start_time = std::chrono::steady_clock::now();
-
-    force_stop = 0;
-
-    int score, result;
-    cache_hit = 0;
-    q_nodes = 0;
-    nodes = 0;
+    // If the move is not a capture or the captured piece is more valuable, no need to perform SEE
+    if (victim_value == 0 || attacked_value <= victim_value) {
+        return victim_value - attacked_value;
+    }
 
-    null_move_pruned = 0;
+    // Temporary board to perform SEE calculation
+    copy_board(*this);
 
-    int alpha = -INT_MAX, beta = INT_MAX;
+    // Perform the capture
+    make_move(move, all_moves);
 
+    // Recursively calculate the SEE value
+    int see_value = victim_value - see(get_smallest_attacker(to));
 
+    // Restore the original board
+    restore_board(*this);
 
-    for (int depth = 0; depth < maxDepth; depth++) {
+    return see_value;
+}
 
-        init_heuristics();
+int Position::get_smallest_attacker(int to) {
+    // This function returns the move of the smallest attacker to the square 'to'
+    // Generate all moves for the opponent's pieces
+    t_moves moves_list;
+    moves_list.count = -1;
+    generate_moves(moves_list);
 
-        ply = 0;
-        pline.cmove = 0;
+    int smallest_attacker_value = INT_MAX;
+    int smallest_attacker_move = 0;
 
-        score = negamax(alpha, beta, depth + 1, 1, DO_NULL, &pline);
+    for (int i = 0; i < moves_list.count; i++) {
+        int move = moves_list.moves[i];
 
-        if (force_stop) break;
+        // Check if the move is a capture and the destination is the target square
+        if (is_capture(move) && decode_destination(move) == to) {
+            int attacker_piece = get_piece(decode_source(move));
+            int attacker_value = piece_scores[attacker_piece];
 
-        // print for each depth
-        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start_time).count();
-        
-        if (score < -CHECKMATE + 2000) {
-            printf("info transpositions %d ttp: %.4f score mate %d depth %d nodes %d q_nodes %d time %ld pv ", cache_hit, ((float)cache_hit)/nodes, -(score + CHECKMATE) / 2 - 1, depth + 1, nodes, q_nodes, elapsed);
-        } else if (score > CHECKMATE - 2000) {
-            printf("info transpositions %d ttp: %.4f score mate %d depth %d nodes %d q_nodes %d time %ld pv ", cache_hit,((float)cache_hit)/nodes, (CHECKMATE - score) / 2 + 1, depth + 1, nodes, q_nodes, elapsed);
-        } else {
-            std::cout << "info transpositions " << cache_hit << " pruned: " << null_move_pruned << " score cp " << score << " depth " << depth + 1 << " nodes " << nodes << " time " << elapsed << " pv ";
-        } 
-        // copy this pline to the previous pline struct so we can use it in next search
-        memcpy(&previous_pv_line, &pline, sizeof(t_line));
-        // previous_pv_line = pline;
-        // print pv lines
-
-        for (int i=0; i<previous_pv_line.cmove; i++) {
-            print_move(previous_pv_line.argmove[i]);
-            printf(" ");
+            // Update the smallest attacker if the current attacker has a lower value
+            if (attacker_value < smallest_attacker_value) {
+                smallest_attacker_value = attacker_value;
+                smallest_attacker_move = move;
+            }
         }
-        std::cout << std::endl;
+    }
 
+    // If there is no attacker, return 0
+    if (smallest_attacker_value == INT_MAX) {
+        return 0;
     }
 
+    return smallest_attacker_move;
+}
 
-    printf("bestmove ");
-    print_move(previous_pv_line.argmove[0]);
-    repitition.table[repitition.count++] = previous_pv_line.argmove[0]; // add this move into repetition table
-    printf("\n");
 
-    return pline.argmove[0];
+bool Position::is_check() const {
+    return is_square_attacked(__builtin_ctzll(bitboards[side==white?K:k]), side^1);
 }
 
 
-float Skunk::evaluation_weights[NUM_WEIGHTS] = {
+float Position::evaluation_weights[NUM_WEIGHTS] = {
     15.0f,  // MATERIAL_WEIGHT
     1.0f,  // PIECE_SCORE_WEIGHT
     4.0f,  // DOUBLED_PAWNS_WEIGHT
@@ -1774,7 +1307,7 @@ float Skunk::evaluation_weights[NUM_WEIGHTS] = {
 };
 
 
-int Skunk::evaluate() {
+int Position::evaluate(PawnHashTable *pawn_table) {
     // material_score is how many total pieces are on the board
     int material_score = 0;
     int white_material_score = 0;
@@ -1801,7 +1334,7 @@ int Skunk::evaluate() {
     material_score = calculate_material_score();
     square_occupancy_score = calculate_square_occupancy_score();
     square_occupancy_score_endgame = calculate_square_occupancy_score_endgame();
-    pawn_structure_score = calculate_pawn_structure_score();
+    pawn_structure_score = calculate_pawn_structure_score(pawn_table);
     mobility_score = calculate_mobility_score();
     king_safety_score = calculate_king_safety_score();
 
@@ -1821,12 +1354,12 @@ int Skunk::evaluate() {
     return (side == white ? score : -score);
 }
 
-float Skunk::calculate_game_phase(int total_material) {
+float Position::calculate_game_phase(int total_material) {
     int max_material = 2 * (piece_scores[Q] + 2 * piece_scores[R] + 2 * piece_scores[B] + 2 * piece_scores[N] + 8 * piece_scores[P] + piece_scores[K]);
     return (float)total_material / max_material;
 }
 
-int Skunk::calculate_material_score() {
+int Position::calculate_material_score() {
     int material_score = 0;
 
     for (int piece = P; piece <= k; piece++) {
@@ -1836,7 +1369,7 @@ int Skunk::calculate_material_score() {
     return material_score;
 }
 
-int Skunk::calculate_square_occupancy_score() {
+int Position::calculate_square_occupancy_score() {
     int score = 0;
     U64 bitboard;
 
@@ -1851,9 +1384,9 @@ int Skunk::calculate_square_occupancy_score() {
 
             // Add/subtract the square score based on the piece color (white or black)
             if (piece >= p)
-                score -= square_scores[piece % 6][mirror_score[square]] * evaluation_weights[PIECE_SCORE_WEIGHT]; // Black piece (lowercase)
+                score -= tables.square_scores[piece % 6][tables.mirror_score[square]] * evaluation_weights[PIECE_SCORE_WEIGHT]; // Black piece (lowercase)
             else
-                score += square_scores[piece % 6][square] * evaluation_weights[PIECE_SCORE_WEIGHT]; // White piece (uppercase)
+                score += tables.square_scores[piece % 6][square] * evaluation_weights[PIECE_SCORE_WEIGHT]; // White piece (uppercase)
 
             // Remove the least significant bit from the bitboard
             pop_lsb(bitboard);
@@ -1863,7 +1396,7 @@ int Skunk::calculate_square_occupancy_score() {
     return score;
 }
 
-int Skunk::calculate_square_occupancy_score_endgame() {
+int Position::calculate_square_occupancy_score_endgame() {
     int score = 0;
     U64 bitboard;
 
@@ -1878,9 +1411,9 @@ int Skunk::calculate_square_occupancy_score_endgame() {
 
             // Add/subtract the square score based on the piece color (white or black)
             if (piece >= p)
-                score -= eg_tables[piece % 6][mirror_score[square]] * evaluation_weights[PIECE_SCORE_WEIGHT]; // Black piece (lowercase)
+                score -= tables.eg_tables[piece % 6][tables.mirror_score[square]] * evaluation_weights[PIECE_SCORE_WEIGHT]; // Black piece (lowercase)
             else
-                score += eg_tables[piece % 6][square] * evaluation_weights[PIECE_SCORE_WEIGHT]; // White piece (uppercase)
+                score += tables.eg_tables[piece % 6][square] * evaluation_weights[PIECE_SCORE_WEIGHT]; // White piece (uppercase)
 
             // Remove the least significant bit from the bitboard
             pop_lsb(bitboard);
@@ -1890,51 +1423,64 @@ int Skunk::calculate_square_occupancy_score_endgame() {
     return score;
 }
 
-int Skunk::calculate_pawn_structure_score() {
-    int pawn_structure_score = 0;
+int Position::calculate_pawn_structure_score(PawnHashTable *pawn_table) {
+    PawnEntry scratch, *entry = &scratch;
+
+    if (pawn_table != nullptr) {
+        entry = &pawn_table->entries[pawn_key & (PAWN_HASH_SIZE - 1)];
+        pawn_table->probes++;
+        if (entry->key == pawn_key) {
+            pawn_table->hits++;
+            return entry->doubled + entry->isolated + entry->passed_score;
+        }
+    }
+
+    int doubled = 0, isolated = 0, passed = 0;
     U64 white_pawns = bitboards[P];
     U64 black_pawns = bitboards[p];
 
     for (int file = 0; file < 8; file++) {
-        U64 white_pawns_on_file = file_masks[MIDDLE][file] & white_pawns;
-        U64 black_pawns_on_file = file_masks[MIDDLE][file] & black_pawns;
+        U64 white_pawns_on_file = tables.file_masks[MIDDLE][file] & white_pawns;
+        U64 black_pawns_on_file = tables.file_masks[MIDDLE][file] & black_pawns;
 
         // Evaluate doubled pawns
         if (bit_count(white_pawns_on_file) > 1) {
-            pawn_structure_score -= evaluation_weights[DOUBLED_PAWNS_WEIGHT] * (float)(bit_count(white_pawns_on_file) - 1);
+            doubled -= evaluation_weights[DOUBLED_PAWNS_WEIGHT] * (float)(bit_count(white_pawns_on_file) - 1);
         }
 
         if (bit_count(black_pawns_on_file) > 1) {
-            pawn_structure_score += evaluation_weights[DOUBLED_PAWNS_WEIGHT] * (float)(bit_count(black_pawns_on_file) - 1);
+            doubled += evaluation_weights[DOUBLED_PAWNS_WEIGHT] * (float)(bit_count(black_pawns_on_file) - 1);
         }
 
 
         // Evaluate isolated pawns
-        bool white_pawns_on_left_file = file > 0 && (file_masks[MIDDLE][file - 1] & bitboards[P]);
-        bool white_pawns_on_right_file = file < 7 && (file_masks[MIDDLE][file + 1] & bitboards[P]);
+        bool white_pawns_on_left_file = file > 0 && (tables.file_masks[MIDDLE][file - 1] & bitboards[P]);
+        bool white_pawns_on_right_file = file < 7 && (tables.file_masks[MIDDLE][file + 1] & bitboards[P]);
 
-        bool black_pawns_on_left_file = file > 0 && (file_masks[MIDDLE][file - 1] & bitboards[p]);
-        bool black_pawns_on_right_file = file < 7 && (file_masks[MIDDLE][file + 1] & bitboards[p]);
+        bool black_pawns_on_left_file = file > 0 && (tables.file_masks[MIDDLE][file - 1] & bitboards[p]);
+        bool black_pawns_on_right_file = file < 7 && (tables.file_masks[MIDDLE][file + 1] & bitboards[p]);
 
         if (white_pawns_on_file && !white_pawns_on_left_file && !white_pawns_on_right_file) {
-            pawn_structure_score -= evaluation_weights[ISOLATED_PAWNS_WEIGHT] * bit_count(white_pawns_on_file);
+            isolated -= evaluation_weights[ISOLATED_PAWNS_WEIGHT] * bit_count(white_pawns_on_file);
         }
 
         if (black_pawns_on_file && !black_pawns_on_left_file && !black_pawns_on_right_file) {
-            pawn_structure_score += evaluation_weights[ISOLATED_PAWNS_WEIGHT] * bit_count(black_pawns_on_file);
+            isolated += evaluation_weights[ISOLATED_PAWNS_WEIGHT] * bit_count(black_pawns_on_file);
         }
     }
 
     // evaluate passed pawns
     int white_passed_pawns = 0, black_passed_pawns = 0;
+    entry->passed[white] = entry->passed[black] = 0ULL;
     
     U64 pawns = white_pawns;
     while (pawns > 0) {
         int square = __builtin_ctzll(pawns);
 
         // get the attacks for this pawn and and it with black pawns to get if it is a passed pawn
-        if ((pawn_attack_span_masks[white][square] & black_pawns) == 0) {
+        if ((tables.pawn_attack_span_masks[white][square] & black_pawns) == 0) {
             white_passed_pawns ++;
+            set_bit(entry->passed[white], square);
         }
         pop_lsb(pawns);
     }
@@ -1944,8 +1490,9 @@ int Skunk::calculate_pawn_structure_score() {
         int square = __builtin_ctzll(pawns);
 
         // get the attacks for this pawn and and it with black pawns to get if it is a passed pawn
-        if ((pawn_attack_span_masks[black][square] & white_pawns) == 0) {
+        if ((tables.pawn_attack_span_masks[black][square] & white_pawns) == 0) {
             black_passed_pawns ++;
+            set_bit(entry->passed[black], square);
         }
 
         pop_lsb(pawns);
@@ -1953,14 +1500,19 @@ int Skunk::calculate_pawn_structure_score() {
 
 
 
-    pawn_structure_score += evaluation_weights[PASSED_PAWN_WEIGHT] * bit_count(white_passed_pawns);
-    pawn_structure_score -= evaluation_weights[PASSED_PAWN_WEIGHT] * bit_count(black_passed_pawns);
+    passed += evaluation_weights[PASSED_PAWN_WEIGHT] * bit_count(white_passed_pawns);
+    passed -= evaluation_weights[PASSED_PAWN_WEIGHT] * bit_count(black_passed_pawns);
 
-    return pawn_structure_score;
+    entry->key = pawn_key;
+    entry->doubled = doubled;
+    entry->isolated = isolated;
+    entry->passed_score = passed;
+
+    return doubled + isolated + passed;
 }
 
 
-int Skunk::calculate_mobility_score() {
+int Position::calculate_mobility_score() {
     int mobility_score = 0;
     int pieces[] = {N, R, B, n, r, b};
 
@@ -1983,7 +1535,7 @@ int Skunk::calculate_mobility_score() {
     return mobility_score;
 }
 
-int Skunk::calculate_king_safety_score() {
+int Position::calculate_king_safety_score() {
     int king_safety_score = 0;
 
 
@@ -2033,190 +1585,11 @@ int Skunk::calculate_king_safety_score() {
 }
 
 
-int Skunk::coordinate_to_square(char *coordinate) {
-    for (int i=0; i<64; i++) {
-        // just bruteforce check which square matches
-        if (strcmp(square_to_coordinate[i], coordinate) == 0) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-
-// what will stop the search and use the PV line
-void Skunk::communicate() {
-
-    /*
-     * If the search is move_time, check if time elapsed has passed
-     */
-    if (move_time > 0) {
-        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start_time).count();
-
-        if (elapsed > move_time) {
-            force_stop = 1;
-            return ;
-        }
-    }
-
-    /*
-     * Polls stdin to see if there is any data to read
-     */
-
-#ifdef _WIN32
-    struct timeval timeout;
-    timeout.tv_usec = 1;
-    timeout.tv_sec = 0;
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(0, &fds);
-    int is_ready = _kbhit();
-#else
-    struct pollfd fd;
-    fd.fd = STDIN_FILENO;
-    fd.events = POLLIN;
-    fd.revents = 0;
-    int is_ready = (poll(&fd, 1, 0)>0 && ((fd.revents & POLLIN) != 0));
-#endif
-
-    // checks if it is ready
-    if (!is_ready) return;
-
-    char input[20];
-    if (fgets(input, 20, stdin) && input[0] != '\n') {
-        // got some data in input, lets parse it
-        if (strncmp(input, "quit", 4)==0) {
-            force_stop = 1;
-        } else if (strncmp(input, "stop", 4)==0) {
-            force_stop = 1;
-        }
-    }
-    fflush(stdin);
-}
-
-void Skunk::parse_go(const std::string& cmd) {
-    search_depth = 0;
-    move_time = 0;
-    btime = 0;
-    wtime = 0;
-
-    std::stringstream ss(cmd);
-    std::string token;
-    while (ss >> token) {
-        if (token == "depth") {
-            ss >> search_depth;
-        } else if (token == "movetime") {
-            ss >> move_time;
-        } else if (token == "wtime") {
-            ss >> wtime;
-        } else if (token == "btime") {
-            ss >> btime;
-        }
-    }
-
-    // Check which type of search to do
-    if (move_time > 0) {
-        search(INT_MAX);
-    } else if (search_depth > 0) {
-        // Do a depth-limited search
-        search(search_depth);
-    } else if (wtime > 0 && btime > 0) {
-        // calculate movetime intelligently
-        move_time = 1000;
-
-        if (side == white) {
-            move_time = std::min(DEFAULT_MOVETIME, wtime);
-        } else {
-            move_time = std::min(DEFAULT_MOVETIME, btime);
-        }
-        
-        // printf("%d\n", move_time);
-        search(INT_MAX);
-    }
-}
-
-
-void Skunk::parse_position(const std::string& command) {
-    /*
-     * command looks something like "position startpos" or "position fen <fen>"
-     */
-    std::string cmd = command.substr(9);
-
-    if (cmd.substr(0, 8) == "startpos") {
-        parse_fen(fen_start);
-    } else {
-        size_t fen_pos = cmd.find("fen");
-        if (fen_pos != std::string::npos) {
-            parse_fen(cmd.substr(fen_pos + 4));
-        } else {
-            parse_fen(fen_start);
-        }
-    }
-
-    size_t moves_pos = cmd.find("moves");
-    repitition.count = 0;
-
-    if (moves_pos != std::string::npos) {
-        std::string moves_str = cmd.substr(moves_pos + 6);
-        std::stringstream moves_ss(moves_str);
-        std::string move_str;
-
-        while (std::getline(moves_ss, move_str, ' ')) {
-            int move = parse_move(move_str);
-
-            if (move == 0) break;
-
-            make_move(move, all_moves);
-            repitition.table[repitition.count++] = zobrist;
-        }
-    }
-}
-
-
-
-
-int Skunk::parse_move(const std::string& move_string) {
-    t_moves moves;
-    generate_moves(moves);
-    if (move_string.length() < 4) return 0;
-
-    int source = (move_string[0] - 'a') + (8 - (move_string[1] - '0')) * 8;
-    int target = (move_string[2] - 'a') + (8 - (move_string[3] - '0')) * 8;
-
-    for (int i=0; i<moves.count; i++) {
-        int move = moves.moves[i];
-        if (decode_source(move)==source && decode_destination(move)==target) {
-            int promoted = decode_promoted(move);
-            // check if it is a promotion or not
-            if (promoted) { // there is a promoted piece available
-                if ((move_string[4]=='r' || move_string[4] == 'R') && (promoted==r || promoted==R)) return move;
-                if ((move_string[4]=='b' || move_string[4] == 'B') && (promoted==b || promoted==B)) return move;
-                if ((move_string[4]=='q' || move_string[4] == 'Q') && (promoted==q || promoted==Q)) return move;
-                if ((move_string[4]=='n' || move_string[4] == 'N') && (promoted==n || promoted==N)) return move;
-                continue;
-            }
-
-            return move;
-        }
-    }
-    return 0;
-}
-
-
 perft perft_results;
 
-void Skunk::parse_perft(const std::string& command) {
-    int depth = 5;
-    std::string depth_str = command.substr(6); // Extract the depth substring
-    depth = std::stoi(depth_str); // Convert the depth substring to an integer
-    perft_test(depth);
-}
-
-
-int Skunk::perft_test(int depth) {
+U64 Position::perft_test(int depth) {
     
-    nodes = 0;
+    U64 nodes = 0;
 
     t_moves moves;
     generate_moves(moves);
@@ -2224,25 +1597,22 @@ int Skunk::perft_test(int depth) {
     auto start = std::chrono::steady_clock::now();
 
     for (int i=0; i<moves.count; i++) {
-        copy_board();
+        copy_board(*this);
 
         make_move(moves.moves[i], all_moves);
 
-        int cummulative_nodes = nodes;
-
-        perft_test_helper(depth - 1);
+        U64 old_nodes = perft_test_helper(depth - 1);
 
-        // old nodes
-        int old_nodes = nodes - cummulative_nodes;
+        nodes += old_nodes;
 
-        restore_board();
+        restore_board(*this);
 
-        printf("%s%s%c %d\n", 
-            square_to_coordinate[decode_source(moves.moves[i])],
-            square_to_coordinate[decode_destination(moves.moves[i])],
-            decode_promoted(moves.moves[i]) ? char_pieces[(decode_promoted(moves.moves[i]) % 6) + 6] : ' ',
+        printf("%s%s%c %llu\n", 
+            tables.square_to_coordinate[decode_source(moves.moves[i])],
+            tables.square_to_coordinate[decode_destination(moves.moves[i])],
+            decode_promoted(moves.moves[i]) ? tables.char_pieces[(decode_promoted(moves.moves[i]) % 6) + 6] : ' ',
             old_nodes);
-        // std::cout << square_to_coordinate[decode_source(moves.moves[i])] << square_to_coordinate[decode_destination(moves.moves[i])] << (decode_promoted(moves.moves[i]) ? char_pieces[(decode_promoted(moves.moves[i]) % 6) + 6] : ' ') << " " << old_nodes << std::endl;;
+        // std::cout << tables.square_to_coordinate[decode_source(moves.moves[i])] << tables.square_to_coordinate[decode_destination(moves.moves[i])] << (decode_promoted(moves.moves[i]) ? tables.char_pieces[(decode_promoted(moves.moves[i]) % 6) + 6] : ' ') << " " << old_nodes << std::endl;;
 
     }
 
@@ -2250,6 +1620,7 @@ int Skunk::perft_test(int depth) {
 
     auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
     std::cout << std::endl <<  nodes << std::endl;
+    return nodes;
     
     // printf("Starting PERFT test...\n");
     // memset(&perft_results, 0, sizeof(perft));
@@ -2281,10 +1652,10 @@ int Skunk::perft_test(int depth) {
     // return perft_results.nodes[1];
 }
 
-bool Skunk::perft_test_position(const std::string &fen, int expected_result, int depth) {
+bool Position::perft_test_position(const std::string &fen, U64 expected_result, int depth) {
     // parse_command("position fen rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", skunk);
     parse_fen(fen);
-    int result = perft_test(depth);
+    U64 result = perft_test(depth);
     if (result == expected_result) {
         std::cout << "\u2713\tPassed (" << result << ")" << std::endl;
         return true;
@@ -2296,20 +1667,20 @@ bool Skunk::perft_test_position(const std::string &fen, int expected_result, int
 }
 
 
-void Skunk::perft_test_helper(int depth) {
+U64 Position::perft_test_helper(int depth) {
     if (depth == 0) {
-        nodes ++;
-        return;
+        return 1;
     }
 
+    U64 nodes = 0;
     t_moves moves;
     generate_moves(moves);
 
     for (int move_count = 0; move_count < moves.count; move_count ++) {
-        copy_board();
+        copy_board(*this);
         make_move(moves.moves[move_count], all_moves);
-        perft_test_helper(depth - 1);
-        restore_board();
+        nodes += perft_test_helper(depth - 1);
+        restore_board(*this);
     }
     
 //     if (depth < 1) return;
@@ -2320,7 +1691,7 @@ void Skunk::perft_test_helper(int depth) {
 
 //     generate_moves(new_moves);
 
-//     copy_board();
+//     copy_board(*this);
 //     int made_moves = 0;
 //     for (int move_count = 0; move_count < new_moves.count; move_count++) {
 
@@ -2354,7 +1725,7 @@ void Skunk::perft_test_helper(int depth) {
 //         perft_test_helper(depth - 1);
 
 
-//         restore_board();
+//         restore_board(*this);
 //     }
 
 //     // move counts differ
@@ -2363,18 +1734,70 @@ void Skunk::perft_test_helper(int depth) {
 // //        print_board();
 // //        getchar();
 // //    }
+    return nodes;
 }
 
-int Skunk::is_repetition() {
-    for (int i = repitition.count-2; i>=0; i--) {
-        if (repitition.table[i] == zobrist) {
-            return 1;
+// Builds the encoded move for a source/target pair straight from the mailbox and checks it is legal, without
+// generating the whole move list. Returns the move exactly as generate_moves would encode it, or 0 if illegal.
+int Position::encode_legal_move(int source, int target, char promotion) {
+    int piece = get_piece(source);
+
+    // there must be a piece of the side to move on the source square
+    if (piece == -1 || (piece <= K) != (side == white)) return 0;
+
+    int pawn = side == white ? P : p;
+    int king = side == white ? K : k;
+    int promoted = 0, enp = 0, castling = 0;
+
+    if (piece == king && abs(target - source) == 2) {
+        int right;
+        U64 empty_mask;
+        switch (target) {
+            case g1: right = wk; empty_mask = castle_mask_wk; break;
+            case c1: right = wq; empty_mask = castle_piece_mask_wq; break;
+            case g8: right = bk; empty_mask = castle_mask_bk; break;
+            case c8: right = bq; empty_mask = castle_piece_mask_bq; break;
+            default: return 0;
+        }
+        if ((castle & right) == 0 || (occupancies[both] & empty_mask)) return 0;
+
+        // the king may not castle out of, through or into check
+        int step = target > source ? 1 : -1;
+        for (int square = source; square != target + step; square += step) {
+            if (is_square_attacked(square, side ^ 1)) return 0;
+        }
+        castling = 1;
+    } else {
+        if ((get_attacks(piece, source, side) & (1ULL << target)) == 0) return 0;
+
+        if (piece == pawn) {
+            enp = target == enpassant && (source & 7) != (target & 7);
+
+            if ((1ULL << target) & (row8 | row1)) {
+                switch (promotion) {
+                    case 'q': case 'Q': promoted = Q; break;
+                    case 'r': case 'R': promoted = R; break;
+                    case 'b': case 'B': promoted = B; break;
+                    case 'n': case 'N': promoted = N; break;
+                    default: return 0;
+                }
+                if (side == black) promoted += 6;
+            }
         }
     }
-    return 0;
+
+    int move = encode_move(source, target, piece, promoted, enp, castling);
+
+    // the move is pseudo legal, make sure it does not leave our own king in check
+    copy_board(*this);
+    make_move(move, all_moves);
+    bool legal = !is_square_attacked(__builtin_ctzll(bitboards[king]), side);
+    restore_board(*this);
+
+    return legal ? move : 0;
 }
 
- int Skunk::make_move(int move, int move_flag) {
+ int Position::make_move(int move, int move_flag) {
 //
     if (move_flag == all_moves) {
 
@@ -2386,7 +1809,8 @@ int Skunk::is_repetition() {
         int promoted = decode_promoted(move);
 
         pop_bit(bitboards[piece], source);
-        zobrist ^= piece_keys[piece][source];
+        mailbox[source] = -1;
+        zobrist ^= zobrist_keys.piece_keys[piece][source];
 
         int pawn = P, knight = N, king = K, queen = Q, bishop = B, rook = R;
         U64 *opponent_bitboards = bitboards + 6;
@@ -2400,35 +1824,48 @@ int Skunk::is_repetition() {
         if (victim > -1) {
             pop_bit(bitboards[victim], target);
             piece_count[victim] --;
-            zobrist ^= piece_keys[victim][target];
+            zobrist ^= zobrist_keys.piece_keys[victim][target];
+            if (victim == P || victim == p) pawn_key ^= zobrist_keys.piece_keys[victim][target];
         }
 
         set_bit(bitboards[piece], target);
-        zobrist ^= piece_keys[piece][target];
+        mailbox[target] = piece;
+        zobrist ^= zobrist_keys.piece_keys[piece][target];
+
+        if (piece == pawn) {
+            pawn_key ^= zobrist_keys.piece_keys[pawn][source];
+            // a promoting pawn leaves the pawn structure
+            if (!promoted) pawn_key ^= zobrist_keys.piece_keys[pawn][target];
+        }
 
         if (promoted) {
             pop_bit(bitboards[pawn], target);
             set_bit(bitboards[promoted], target);
+            mailbox[target] = promoted;
             piece_count[pawn] --;
             piece_count[promoted] ++;
-            zobrist ^= piece_keys[pawn][target];
-            zobrist ^= piece_keys[promoted][target];
+            zobrist ^= zobrist_keys.piece_keys[pawn][target];
+            zobrist ^= zobrist_keys.piece_keys[promoted][target];
         }
 
         if (enp) {
             if (side == white) {
                 pop_bit(bitboards[p], target + 8);
+                mailbox[target + 8] = -1;
                 piece_count[p] --;
-                zobrist ^= piece_keys[p][target + 8];
+                zobrist ^= zobrist_keys.piece_keys[p][target + 8];
+                pawn_key ^= zobrist_keys.piece_keys[p][target + 8];
             } else {
                 pop_bit(bitboards[P], target - 8);
+                mailbox[target - 8] = -1;
                 piece_count[P] --;
-                zobrist ^= piece_keys[P][target - 8];
+                zobrist ^= zobrist_keys.piece_keys[P][target - 8];
+                pawn_key ^= zobrist_keys.piece_keys[P][target - 8];
             }
         }
 
         if (enpassant != no_square) {
-            zobrist ^= enpassant_keys[enpassant];
+            zobrist ^= zobrist_keys.enpassant_keys[enpassant];
         }
 
         enpassant = no_square;
@@ -2436,47 +1873,54 @@ int Skunk::is_repetition() {
         if (piece == pawn && abs(source - target) == 16) {
             if (side == white) {
                 enpassant = target + 8;
-                zobrist ^= enpassant_keys[target + 8];
+                zobrist ^= zobrist_keys.enpassant_keys[target + 8];
             } else {
                 enpassant = target - 8;
-                zobrist ^= enpassant_keys[target - 8];
+                zobrist ^= zobrist_keys.enpassant_keys[target - 8];
             }
         }
 
         if (castling) {
-            castled = 1;
             switch (target) {
                 case g1:
                     pop_bit(bitboards[R], h1);
                     set_bit(bitboards[R], f1);
-                    zobrist ^= piece_keys[R][h1];
-                    zobrist ^= piece_keys[R][f1];
+                    mailbox[h1] = -1;
+                    mailbox[f1] = R;
+                    zobrist ^= zobrist_keys.piece_keys[R][h1];
+                    zobrist ^= zobrist_keys.piece_keys[R][f1];
                     break;
                 case c1:
                     pop_bit(bitboards[R], a1);
                     set_bit(bitboards[R], d1);
-                    zobrist ^= piece_keys[R][a1];
-                    zobrist ^= piece_keys[R][d1];
+                    mailbox[a1] = -1;
+                    mailbox[d1] = R;
+                    zobrist ^= zobrist_keys.piece_keys[R][a1];
+                    zobrist ^= zobrist_keys.piece_keys[R][d1];
                     break;
                 case g8:
                     pop_bit(bitboards[r], h8);
                     set_bit(bitboards[r], f8);
-                    zobrist ^= piece_keys[r][h8];
-                    zobrist ^= piece_keys[r][f8];
+                    mailbox[h8] = -1;
+                    mailbox[f8] = r;
+                    zobrist ^= zobrist_keys.piece_keys[r][h8];
+                    zobrist ^= zobrist_keys.piece_keys[r][f8];
                     break;
                 case c8:
                     pop_bit(bitboards[r], a8);
                     set_bit(bitboards[r], d8);
-                    zobrist ^= piece_keys[r][a8];
-                    zobrist ^= piece_keys[r][d8];
+                    mailbox[a8] = -1;
+                    mailbox[d8] = r;
+                    zobrist ^= zobrist_keys.piece_keys[r][a8];
+                    zobrist ^= zobrist_keys.piece_keys[r][d8];
                     break;
             }
         }
 
-        zobrist ^= castle_keys[castle];
-        castle &= castling_rights[source];
-        castle &= castling_rights[target];
-        zobrist ^= castle_keys[castle];
+        zobrist ^= zobrist_keys.castle_keys[castle];
+        castle &= tables.castling_rights[source];
+        castle &= tables.castling_rights[target];
+        zobrist ^= zobrist_keys.castle_keys[castle];
 
         occupancies[white] = 0;
         occupancies[black] = 0;
@@ -2498,9 +1942,7 @@ int Skunk::is_repetition() {
 
         side ^= 1;
 
-        moves ++;
-
-        zobrist ^= side_key;
+        zobrist ^= zobrist_keys.side_key;
 
         return 1;
     } else {
@@ -2513,41 +1955,65 @@ int Skunk::is_repetition() {
     }
 }
 
-void Skunk::print_move_detailed(int move) {
-    printf("%-9d %-6s %-8s %-7c %-9d %-9d %-9d\n",
-           move,
-           square_to_coordinate[decode_source(move)],
-           square_to_coordinate[decode_destination(move)],
-           ascii_pieces[decode_piece(move)],
-           score_move(move),
-           decode_enpassant(move),
-           decode_castle(move)
-    );
-}
-void Skunk::show_sort() {
-    t_moves moves_list;
-    generate_moves(moves_list);
-    printf("Moves before sort:\n");
-    for (int i=0; i<moves_list.count; i++) {
-        print_move(moves_list.moves[i]);
-        printf("\n");
+// the zobrist key of the position after move, without making it (so the hash entry can be prefetched early)
+U64 Position::key_after(int move) const {
+    int source = decode_source(move);
+    int target = decode_destination(move);
+    int piece = decode_piece(move);
+    int promoted = decode_promoted(move);
+    int victim = get_piece(target);
+
+    U64 key = zobrist ^ zobrist_keys.side_key;
+    key ^= zobrist_keys.piece_keys[piece][source];
+    key ^= zobrist_keys.piece_keys[promoted ? promoted : piece][target];
+
+    if (victim > -1) key ^= zobrist_keys.piece_keys[victim][target];
+
+    if (decode_enpassant(move)) {
+        key ^= side == white ? zobrist_keys.piece_keys[p][target + 8] : zobrist_keys.piece_keys[P][target - 8];
+    }
+
+    if (enpassant != no_square) key ^= zobrist_keys.enpassant_keys[enpassant];
+
+    if ((piece == P || piece == p) && abs(source - target) == 16) {
+        key ^= zobrist_keys.enpassant_keys[(source + target) / 2];
     }
-    sort_moves(moves_list.moves, moves_list.count);
-    printf("After sort:\n");
-    for (int i=0; i<moves_list.count; i++) {
-        print_move(moves_list.moves[i]);
-        printf("\n");
+
+    if (decode_castle(move)) {
+        switch (target) {
+            case g1: key ^= zobrist_keys.piece_keys[R][h1] ^ zobrist_keys.piece_keys[R][f1]; break;
+            case c1: key ^= zobrist_keys.piece_keys[R][a1] ^ zobrist_keys.piece_keys[R][d1]; break;
+            case g8: key ^= zobrist_keys.piece_keys[r][h8] ^ zobrist_keys.piece_keys[r][f8]; break;
+            case c8: key ^= zobrist_keys.piece_keys[r][a8] ^ zobrist_keys.piece_keys[r][d8]; break;
+        }
     }
+
+    key ^= zobrist_keys.castle_keys[castle];
+    key ^= zobrist_keys.castle_keys[castle & tables.castling_rights[source] & tables.castling_rights[target]];
+
+    return key;
 }
-void Skunk::print_move(int move) {
-    int promoted = decode_promoted(move);
-    if (promoted) {
-        printf("%s%s%c", square_to_coordinate[decode_source(move)],
-               square_to_coordinate[decode_destination(move)],
-               ascii_pieces[promoted]);
+
+// the pawn key after move, the same as pawn_key unless a pawn moves or is taken
+U64 Position::pawn_key_after(int move) const {
+    int source = decode_source(move);
+    int target = decode_destination(move);
+    int piece = decode_piece(move);
+    int victim = get_piece(target);
+
+    U64 key = pawn_key;
+    if (victim == P || victim == p) key ^= zobrist_keys.piece_keys[victim][target];
+
+    if (piece == P || piece == p) {
+        key ^= zobrist_keys.piece_keys[piece][source];
+        // a promoting pawn leaves the pawn structure
+        if (!decode_promoted(move)) key ^= zobrist_keys.piece_keys[piece][target];
     }
 
-    else
-        printf("%s%s", square_to_coordinate[decode_source(move)],
-               square_to_coordinate[decode_destination(move)]);
-}
\ No newline at end of file
+    if (decode_enpassant(move)) {
+        key ^= side == white ? zobrist_keys.piece_keys[p][target + 8] : zobrist_keys.piece_keys[P][target - 8];
+    }
+
+    return key;
+}
+
@@ -12,8 +12,13 @@
 #include <algorithm>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <type_traits>
 #include "masks.h"
 #include "piece_tables.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #ifdef _WIN32
 #include <conio.h>
 #include <Windows.h>
@@ -28,8 +33,8 @@
 // flag for enabling asserts in the code for debugging and error checking i.e. zobrist key checking
 //#define DEBUG
 
-// transposition table size
-#define HASH_SIZE (1 << 20)
+// default transposition table size in megabytes, changed at runtime with "setoption name Hash"
+#define HASH_SIZE_MB 16
 
 // flag for enabling the transposition table
 #define TRANSPOSITION_TABLE
@@ -51,19 +56,28 @@
 #define LMR_MIN_DEPTH 3
 #define LMR_REDUCTION 2
 
+// iterations from this depth on start in a window of ASPIRATION_DELTA around the last score, the window
+// doubles on every fail low or fail high
+#define ASPIRATION_MIN_DEPTH 4
+#define ASPIRATION_DELTA 30
+
+// depths quiescence results are stored at in the transposition table
+#define QS_DEPTH 0
+#define QS_CHECK_DEPTH -1
+
 /*********************\
        CONSTANTS
 \*********************/
 
 #define MAX_PLY 72
-#define CHECKMATE 500000
+#define CHECKMATE 32000
 #define NULL_R 3
 #define DO_NULL 1
 #define NO_NULL 0
 #define HASH_EXACT 0
 #define HASH_LOWERBOUND 1
 #define HASH_UPPERBOUND 2
-#define DEFAULT_MOVETIME 2500 // how many ms to search for
+#define DEFAULT_MOVE_OVERHEAD 10 // ms lost per move to the GUI and the connection
 
 
 
@@ -101,26 +115,14 @@
 #define decode_destination(move) (((move) & 0xfc0) >> 6)
 #define decode_piece(move) (((move) & 0xf000) >> 12)
 #define decode_promoted(move) (((move) & 0xf0000) >> 16)
-#define is_capture(move) ((1ULL << decode_destination(move)) & occupancies[side ^ 1] || decode_enpassant(move))
 #define decode_enpassant(move) ((move) & 0x400000)
 #define decode_castle(move) ((move) & 0x800000)
 
 
-#define copy_board() \
-U64 bitboards_copy[12], occupancies_copy[3]; \
-int castle_copy=0, side_copy=0, enpassant_copy=0, piece_count_copy[12]; \
-memcpy(bitboards_copy, bitboards, sizeof(bitboards)); \
-memcpy(occupancies_copy, occupancies, sizeof(occupancies)); \
-memcpy(piece_count_copy, piece_count, sizeof(piece_count));                     \
-enpassant_copy = enpassant; castle_copy = castle; side_copy = side; \
-U64 zobrist_copy = zobrist; \
+// Position is trivially copyable, so taking a snapshot before make_move and restoring it afterwards is a plain struct copy
+#define copy_board(board) Position board_copy = (board);
 
-#define restore_board() \
-    memcpy(bitboards, bitboards_copy, sizeof(bitboards)); \
-    memcpy(occupancies, occupancies_copy,  sizeof(occupancies)); \
-    memcpy(piece_count, piece_count_copy, sizeof(piece_count));                    \
-    enpassant = enpassant_copy; castle = castle_copy; side = side_copy; \
-    zobrist = zobrist_copy; \
+#define restore_board(board) (board) = board_copy;
 
 
 /*********************\
@@ -187,15 +189,6 @@ const char ascii_pieces[] = "PNBRQKpnbrqk";
        STRUCTS
 \*********************/
 
-// transposition table
-struct TTEntry {
-    U64 zobristKey;
-    int value;
-    int move;
-    int16_t depth;
-    uint8_t type;
-};
-
 typedef struct {
     int moves[256];
     int count;
@@ -237,29 +230,88 @@ typedef struct {
 } t_repitition;
 
 
+
+
+#ifdef __AVX2__
+// attacks of all orthogonal and diagonal sliders through the empty squares, every direction in one pass
+U64 kogge_stone_slider_attacks(U64 orthogonal, U64 diagonal, U64 empty);
+#endif
+
+// population count used by the evaluation terms
+inline int bit_count(U64 board) {
+    int count = 0;
+    while (board)
+    {
+        count ++;
+        board &= board - 1;
+    }
+    return count;
+}
+
+
 /*********************\
-    SKUNK CLASS
+     ZOBRIST KEYS
 \*********************/
 
-class Skunk {
-public:
+struct ZobristKeys {
+    U64 piece_keys[12][64];
+    U64 enpassant_keys[64];
+    U64 castle_keys[16];
+    U64 side_key;
+};
+
+// Runs the xorshift generator the keys have always come from at compile time, so the keys are fixed for the
+// life of the process and setting up a position never touches the random number generator.
+constexpr ZobristKeys generate_zobrist_keys() {
+    ZobristKeys keys{};
+    unsigned int seed = 4091583267;//1804289383;
+
+    // generate 32-bit pseudo legal numbers (XOR shift algorithm)
+    auto get_random_U32_number = [&seed]() {
+        unsigned int number = seed;
+        number ^= number << 13;
+        number ^= number >> 17;
+        number ^= number << 5;
+        seed = number;
+        return number;
+    };
 
-    static float evaluation_weights[NUM_WEIGHTS];
+    // generate 64-bit pseudo legal numbers, slicing 16 bits from each 32-bit number
+    auto get_random_U64_number = [&get_random_U32_number]() {
+        U64 n1 = (U64)(get_random_U32_number()) & 0xFFFF;
+        U64 n2 = (U64)(get_random_U32_number()) & 0xFFFF;
+        U64 n3 = (U64)(get_random_U32_number()) & 0xFFFF;
+        U64 n4 = (U64)(get_random_U32_number()) & 0xFFFF;
+        return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
+    };
 
-    U64 pawn_attack_span_masks[2][64];
+    for (int piece = P; piece <= k; piece++) {
+        for (int square = 0; square < 64; square++) {
+            keys.piece_keys[piece][square] = get_random_U64_number();
+        }
+    }
+    for (int square = 0; square < 64; square++) {
+        keys.enpassant_keys[square] = get_random_U64_number();
+    }
+    for (int i = 0; i < 16; i++) {
+        keys.castle_keys[i] = get_random_U64_number();
+    }
+    keys.side_key = get_random_U64_number();
 
+    return keys;
+}
+
+inline constexpr ZobristKeys zobrist_keys = generate_zobrist_keys();
+
+
+/*********************\
+     SHARED TABLES
+\*********************/
+
+// Everything that only depends on the rules of chess (attack masks, magic lookups, rays, lookup constants).
+// Built once at startup and shared read-only by every position and search thread.
+struct Tables {
 
-    const int lsb_64_table[64] =
-            {
-                    63, 30,  3, 32, 59, 14, 11, 33,
-                    60, 24, 50,  9, 55, 19, 21, 34,
-                    61, 29,  2, 53, 51, 23, 41, 18,
-                    56, 28,  1, 43, 46, 27,  0, 35,
-                    62, 31, 58,  4,  5, 49, 54,  6,
-                    15, 52, 12, 40,  7, 42, 45, 16,
-                    25, 57, 48, 13, 10, 39,  8, 44,
-                    20, 47, 38, 22, 17, 37, 36, 26
-            };
     const char *square_to_coordinate[64] = {
             "a8", "b8", "c8", "d8", "e8", "f8", "g8", "h8",
             "a7", "b7", "c7", "d7", "e7", "f7", "g7", "h7",
@@ -270,7 +322,6 @@ public:
             "a2", "b2", "c2", "d2", "e2", "f2", "g2", "h2",
             "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1"};
 
-    
 
     const int bishop_relevant_bits[64] = {
             6, 5, 5, 5, 5, 5, 5, 6,
@@ -429,7 +480,7 @@ public:
 
     // convert ASCII character pieces to encoded constants
 #ifndef _WIN32
-    char *unicode_pieces[12] = { "♙", "♘", "♗", "♖", "♕", "♔","♟︎", "♞", "♝", "♜", "♛", "♚" };
+    const char *unicode_pieces[12] = { "♙", "♘", "♗", "♖", "♕", "♔","♟︎", "♞", "♝", "♜", "♛", "♚" };
 #endif
 
 
@@ -473,21 +524,27 @@ public:
             101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
             100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600
     };
-    unsigned int seed = 1804289383;
-    // int char_pieces[115];
-    int char_pieces[128] = {
-        ['P'] = P, ['N'] = N, ['B'] = B, ['R'] = R, ['Q'] = Q, ['K'] = K,
-        ['p'] = p, ['n'] = n, ['b'] = b, ['r'] = r, ['q'] = q, ['k'] = k,
-    };
+    int char_pieces[128];
 
+    const int *square_scores[6] = {pawn_score, knight_score, bishop_score, rook_score, king_score, queen_score};
 
-    Skunk();
-    ~Skunk();
+    const int *mg_tables[6] = {
+            mg_pawn_table,
+            mg_knight_table,
+            mg_bishop_table,
+            mg_rook_table,
+            mg_queen_table,
+            mg_king_table,
+    };
 
-    void parse_fen(const std::string& fen);
-    void print_bitboard(U64 board);
-    void print_board();
-    void print_attacks(int side);
+    const int *eg_tables[6] = {
+            eg_pawn_table,
+            eg_knight_table,
+            eg_bishop_table,
+            eg_rook_table,
+            eg_queen_table,
+            eg_king_table,
+    };
 
     U64 pawn_masks[2][64];
     U64 knight_masks[64];
@@ -496,173 +553,149 @@ public:
     U64 rook_masks[64];
     U64 rook_attacks[64][4096];
     U64 bishop_attacks[64][512];
-    U64 occupancies[3];
-    U64 bitboards[12];
     U64 rays[64][64];
     U64 file_masks[3][64];
-    int get_piece(int square);
-    U64 get_attacks(int piece, int square, int side);
+    U64 pawn_attack_span_masks[2][64];
     int nearest_square[8][64]; // given a direction and a square, give me the furthest square in that direction
 
-    // EVALUATION
-    int king_distance_heuristic[5] = {10, 20, 25, 30, 40};
-    int castled = 0;
-    int moves = 0;
+    Tables();
 
-    // ZOBRISK HASHING
-    U64 piece_keys[12][64];
-    U64 enpassant_keys[64];
-    U64 castle_keys[16];
-    U64 side_key;
-    U64 zobrist = 0ULL;
-
-    int piece_count[12];
-    int killer_moves[2][MAX_PLY];
-    //history, side->source->destination (alternative could be piece->destination)
-    // int history_moves[2][64][64];
-    
-
-    // History table (for each piece type and destination square)
-    int history_table[12][64];
-
-    // repitition array for 3 move repitition
-    t_repitition repitition;
+    inline U64 get_rook_attacks(int square, U64 occupancy) const {
+        occupancy &= rook_masks[square];
+        occupancy *= rook_magic_numbers[square];
+        occupancy >>= 64 - rook_relevant_bits[square];
+        return rook_attacks[square][occupancy];
+    }
 
+    inline U64 get_bishop_attacks(int square, U64 occupancy) const {
+        occupancy &= bishop_masks[square];
+        occupancy *= bishop_magic_numbers[square];
+        occupancy >>= 64 - bishop_relevant_bits[square];
+        return bishop_attacks[square][occupancy];
+    }
 
+    inline U64 get_queen_attacks(int square, U64 occupancy) const {
+        return get_rook_attacks(square, occupancy) | get_bishop_attacks(square, occupancy);
+    }
 
-    t_line previous_pv_line;
-    
-    
-    TTEntry transpositionTable[HASH_SIZE];
-    enum NodeType { LOWER_BOUND, UPPER_BOUND, EXACT };
-    TTEntry *probe_transposition_table(U64 zobristKey);
-    void store_transposition_table(U64 zobristKey, int16_t value, int16_t depth, int move, NodeType type);
+    int coordinate_to_square(const char *coordinate) const;
+    void print_move(int move) const;
 
-    int get_time_ms();
-    inline int is_repetition();
+private:
+    void construct_pawn_tables();
+    void construct_knight_masks();
+    void construct_king_tables();
+    void construct_bishop_tables();
+    void construct_rook_tables();
+    void construct_slider_attacks();
+    void construct_rays();
+    void construct_file_masks();
+    void construct_direction_rays();
     void init_precomputed_masks();
     U64 pawn_attack_span(int color, int square);
-    void update_heuristics(int ply, int move, int depth);
-    inline void init_heuristics();
-    inline void construct_rays();
-    inline void construct_file_masks();
-    inline void construct_direction_rays();
-    inline U64 construct_bishop_attacks(int square, U64 blockers);
-    inline U64 construct_rook_attacks(int square, U64 blockers);
-    inline U64 get_rook_attacks(int square, U64 occupancy);
-    inline U64 get_bishop_attacks(int square, U64 occupancy);
-    inline U64 get_queen_attacks(int square, U64 occupancy);
-    inline bool is_square_attacked(int square, int side);
-    inline U64 get_slider_attacks();
-    inline U64 get_jumper_attacks();
-    int bit_count(U64 board);
-    int get_ls1b_index(U64 board);
+    U64 construct_bishop_attacks(int square, U64 blockers);
+    U64 construct_rook_attacks(int square, U64 blockers);
     U64 set_occupancy(int index, int bits_in_mask, U64 attack_mask);
-    inline void fill_occupancies();
-    inline void generate_moves(t_moves &moves_list);
-    inline void print_move_detailed(int move);
-    inline int make_move(int move, int move_flag);
-    inline int perft_test(int depth);
-    bool perft_test_position(const std::string &fen, int expected_result, int depth);
-    int evaluate();
-    inline int null_ok();
-    inline int search(int maxDepth);
-    inline int negamax(int alpha, int beta, int depth, int verify, int do_null, t_line *pline);
-    inline int quiesence(int alpha, int beta);
-    void show_sort();
-    inline bool is_check();
-    inline int coordinate_to_square(char *coordinate);
-    inline int score_move(int move);
-    void sort_moves(int *moves, int num_moves);
-    inline unsigned int get_random_U32_number();
-    inline U64 get_random_U64_number();
-    inline U64 generate_zobrist();
-    inline void print_move(int move);
-    inline void init();
-    inline void test_moves_sort();
-    void print_moves(t_moves &moves_list);
-
-    // time functions to incorporate time checking
-    std::chrono::steady_clock::time_point start_time;
+};
 
-    const int *square_scores[6] = {pawn_score, knight_score, bishop_score, rook_score, king_score, queen_score};
+extern const Tables tables;
 
-    const int *mg_tables[6] = {
-            mg_pawn_table,
-            mg_knight_table,
-            mg_bishop_table,
-            mg_rook_table,
-            mg_queen_table,
-            mg_king_table,
-    };
 
-    const int *eg_tables[6] = {
-            eg_pawn_table,
-            eg_knight_table,
-            eg_bishop_table,
-            eg_rook_table,
-            eg_queen_table,
-            eg_king_table,
-    };
+/*********************\
+      PAWN HASH
+\*********************/
+
+#define PAWN_HASH_SIZE (1 << 14)
+
+// The pawn structure terms for one arrangement of pawns, scored for white. A zeroed entry is already
+// correct for the pawnless key 0, so the table needs no valid flag.
+struct PawnEntry {
+    U64 key;
+    U64 passed[2];      // passed pawns of each side
+    int16_t doubled;
+    int16_t isolated;
+    int16_t passed_score;
+};
 
+// Direct mapped and owned by one search thread. Pawns rarely move between nodes, so most lookups hit.
+struct PawnHashTable {
+    PawnEntry entries[PAWN_HASH_SIZE] = {};
+    int probes = 0;
+    int hits = 0;
+
+    void prefetch(U64 key) const { __builtin_prefetch(&entries[key & (PAWN_HASH_SIZE - 1)]); }
+};
 
-    // UCI commands/helper functions
 
-    void communicate();
-    int parse_move(const std::string& move_string);
-    void parse_position(const std::string& command);
-    void parse_go(const std::string& cmd);
-    void parse_option(char *command);
-    void parse_debug(char *command);
-    void parse_perft(const std::string& move_string);
-    bool should_do_null_move();
+/*********************\
+    POSITION STRUCT
+\*********************/
+
+// The complete state of a board. Plain data with no owning members so it can be copied with a struct assignment,
+// which is how make_move is undone and how each search thread gets its own board.
+struct Position {
+    U64 bitboards[12];
+    U64 occupancies[3];
+    U64 zobrist;
+    U64 pawn_key;           // zobrist of the pawns alone, indexes the pawn hash
+    int8_t mailbox[64];     // piece on each square, -1 when empty
+    int8_t piece_count[12];
+    uint8_t side;
+    uint8_t castle;
+    uint8_t enpassant;
+
+    static float evaluation_weights[NUM_WEIGHTS];
+    static constexpr int king_distance_heuristic[5] = {10, 20, 25, 30, 40};
+
+    void clear();
+    bool parse_fen(const std::string& fen);
+    size_t set_position(const char *fen, size_t length);
+    void print_bitboard(U64 board) const;
+    void print_board();
+    void print_attacks(int side) const;
+
+    inline int get_piece(int square) const {
+        return mailbox[square];
+    }
+
+    inline bool is_capture(int move) const {
+        return ((1ULL << decode_destination(move)) & occupancies[side ^ 1]) || decode_enpassant(move);
+    }
+
+    U64 get_attacks(int piece, int square, int side) const;
+    bool is_square_attacked(int square, int side) const;
+    bool is_check() const;
+    U64 get_slider_attacks() const;
+    U64 get_slider_attacks_magic() const;
+    void bench_slider_attacks(int iterations) const;
+    U64 get_jumper_attacks() const;
+    void fill_occupancies();
+    U64 generate_zobrist() const;
+    void generate_moves(t_moves &moves_list);
+    int make_move(int move, int move_flag);
+    U64 key_after(int move) const;
+    U64 pawn_key_after(int move) const;
+    int encode_legal_move(int source, int target, char promotion);
     int see(int move);
     int get_smallest_attacker(int to);
-    size_t null_move_pruned = 0;
-    char *fen_start = (char *)"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
-    int force_stop = 0;
-    int wtime = 0;
-    int btime = 0;
-    int winc = 0;
-    int binc = 0;
-    int search_depth = 0;
-    int move_time = 0; // default time to search in milliseconds
-    int UCI_AnalyseMode = 1;
-    int time_check_node_interval = 50000;
-    int enpassant = no_square;
-    int side = white;
-
-//    int weights[10] = {};
+    int evaluate(PawnHashTable *pawn_table = nullptr);
 
+    U64 perft_test(int depth);
+    bool perft_test_position(const std::string &fen, U64 expected_result, int depth);
 
 private:
-    void perft_test_helper(int depth);
-
-    //Functions for getting each pieces valid t_moves (takes whose turn it should calculate for)
-    //State for our pseudo random number generator
-    //All of our bitboards
-    void construct_pawn_tables();
-    void construct_knight_masks();
-    void construct_king_tables();
-    void construct_bishop_tables();
-    void construct_rook_tables();
-    void construct_slider_attacks();
-    void add_move(t_moves &moves_list, int move);
-    void clear_moves();
+    U64 perft_test_helper(int depth);
     int calculate_material_score();
     int calculate_square_occupancy_score();
     int calculate_square_occupancy_score_endgame();
-    int calculate_pawn_structure_score();
-    int calculate_passed_pawn_score();
+    int calculate_pawn_structure_score(PawnHashTable *pawn_table);
     int calculate_mobility_score();
     int calculate_king_safety_score();
     float calculate_game_phase(int material_score);
-    int castle = 0;
-    int full_moves = 0;
-    int ply = 0;
-    int nodes = 0;
-    int q_nodes = 0;
-    int cache_hit = 0;
-    int cache_miss = 0;
 };
-#endif //BITBOT_BOARD_H
\ No newline at end of file
+
+static_assert(std::is_trivially_copyable<Position>::value, "Position must stay copyable with memcpy");
+static_assert(std::is_standard_layout<Position>::value, "Position must stay plain data");
+static_assert(sizeof(Position) <= 256, "Position should stay within four cache lines");
+
+#endif //BITBOT_BOARD_H
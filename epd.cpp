@@ -0,0 +1,72 @@
+#include "epd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+EpdReader::EpdReader(const char *path) {
+#ifdef _WIN32
+    // no mmap, read the whole file in once instead
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) return;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *buffer = (char *)malloc(length > 0 ? length : 1);
+    size = fread(buffer, 1, length > 0 ? length : 0, file);
+    fclose(file);
+    data = buffer;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            data = (const char *)mapping;
+            size = info.st_size;
+        }
+    }
+    close(fd);
+#endif
+}
+
+EpdReader::~EpdReader() {
+    if (data == nullptr) return;
+#ifdef _WIN32
+    free((void *)data);
+#else
+    munmap((void *)data, size);
+#endif
+}
+
+bool EpdReader::next(Position &pos) {
+    while (offset < size) {
+        const char *line = data + offset;
+        const char *newline = (const char *)memchr(line, '\n', size - offset);
+        size_t length = newline ? newline - line : size - offset;
+        offset += length + 1;
+        line_number++;
+
+        // tolerate CRLF line endings
+        if (length > 0 && line[length - 1] == '\r') length--;
+        if (length == 0) continue;
+
+        size_t consumed = pos.set_position(line, length);
+        if (consumed == 0) continue;
+
+        operations = line + consumed;
+        operations_length = length - consumed;
+        while (operations_length > 0 && *operations == ' ') {
+            operations++;
+            operations_length--;
+        }
+        return true;
+    }
+    return false;
+}
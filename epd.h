@@ -0,0 +1,38 @@
+#ifndef SKUNK_EPD_H
+#define SKUNK_EPD_H
+
+#include "board.h"
+
+/*********************\
+      EPD READER
+\*********************/
+
+// Streams positions out of a FEN or EPD file, one record per line. The file is mapped into memory and every
+// record is parsed in place with Position::set_position, so reading a position performs no heap allocation.
+class EpdReader {
+public:
+    explicit EpdReader(const char *path);
+    ~EpdReader();
+
+    EpdReader(const EpdReader &) = delete;
+    EpdReader &operator=(const EpdReader &) = delete;
+
+    bool is_open() const { return data != nullptr; }
+
+    // sets up the next position in the file, skipping blank and malformed lines. Returns false at the end of the file
+    bool next(Position &pos);
+
+    // the rest of the line returned by the last call to next(), i.e. the EPD operations ("bm e4; id ...")
+    const char *operations = nullptr;
+    size_t operations_length = 0;
+
+    // 1-based line number of the record returned by the last call to next()
+    size_t line_number = 0;
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+};
+
+#endif //SKUNK_EPD_H
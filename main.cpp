@@ -1,7 +1,8 @@
 #include <iostream>
 #include <stdint.h>
 #include <vector>
-#include "board.h"
+#include "search.h"
+#include "epd.h"
 #include <sstream>
 
 using namespace std;
@@ -20,18 +21,25 @@ void parse_command(const std::string& cmd, Skunk* skunk);
 
 void test_positions();
 
+void run_epd(const char *path, int depth);
+
 std::vector<std::string> split_command(const std::string& input);
 
 int main(int argc, char **argv) {
     if (argc > 1 && strcmp(argv[1], "test_suite")==0) {
         test_positions();
+    } else if (argc > 2 && strcmp(argv[1], "epd")==0) {
+        run_epd(argv[2], argc > 3 ? atoi(argv[3]) : 0);
     } else if (argc > 2) {
         
         Skunk *skunk = new Skunk();
 
         int depth = atoi(argv[1]);
         // set the position
-        skunk->parse_fen(argv[2]);
+        if (!skunk->parse_fen(argv[2])) {
+            printf("invalid fen \"%s\"\n", argv[2]);
+            return 1;
+        }
 
         // std::cout << depth << ":" << argv[2] << ":" << argv[3] << std::endl;
         if (argc > 3) {
@@ -44,11 +52,11 @@ int main(int argc, char **argv) {
 
                 if (move == 0) break;
 
-                skunk->make_move(move, all_moves);
+                skunk->position.make_move(move, all_moves);
             }
         }
 
-        skunk->perft_test(depth);
+        skunk->position.perft_test(depth);
 
     } else {
         uci_loop();
@@ -81,13 +89,46 @@ void test_positions() {
 
 }
 
+/*
+ * Streams every position of a FEN/EPD file through the engine. With a depth each position is searched and its
+ * bestmove printed, without one only the position setup is timed.
+ */
+void run_epd(const char *path, int depth) {
+    EpdReader reader(path);
+    if (!reader.is_open()) {
+        std::cout << "could not open " << path << std::endl;
+        return;
+    }
+
+    Skunk *skunk = new Skunk();
+    size_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (reader.next(skunk->position)) {
+        count++;
+        if (depth > 0) {
+            skunk->repitition.count = 0;
+            skunk->search(depth);
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "positions " << count << " time " << elapsed << " ms" << std::endl;
+
+    delete skunk;
+}
+
 
 void uci_loop() {
     Skunk *skunk = new Skunk();
     std::string input;
 
     while (true) {
-        std::getline(std::cin, input);
+        // at the end of the input let a running search finish, then leave
+        if (!std::getline(std::cin, input)) {
+            skunk->wait_for_search();
+            break;
+        }
 
         if (input.empty()) {
             continue;
@@ -98,6 +139,7 @@ void uci_loop() {
         bool shouldStop = false;
         for (const std::string& command : commands) {
             if (command.substr(0, 4) == "quit") {
+                skunk->stop_search();
                 shouldStop = true;
                 break;
             }
@@ -123,17 +165,35 @@ std::vector<std::string> split_command(const std::string& input) {
 }
 
 void parse_command(const std::string& cmd, Skunk* skunk) {
+    // commands that touch the position, the options or the tables wait for a running search to finish.
+    // isready, stop and ponderhit are answered straight away, and unknown input is ignored without blocking
+    static const char *waits_for_search[] = {"uci", "setoption", "position", "go", "ucinewgame", "savehash", "loadhash",
+                                             "perft", "board", "score", "sort", "sliderbench"};
+    for (const char *command : waits_for_search) {
+        if (cmd.compare(0, strlen(command), command) == 0) {
+            skunk->wait_for_search();
+            break;
+        }
+    }
+
     if (cmd == "uci") {
         // Respond to the "uci" command by printing the engine name and options
         std::cout << "id name Skunk" << std::endl;
         std::cout << "id author Jeremy Colegrove" << std::endl;
+        std::cout << "option name Hash type spin default " << HASH_SIZE_MB << " min 1 max " << TranspositionTable::max_megabytes() << std::endl;
+        std::cout << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << std::endl;
+        std::cout << "option name MultiPV type spin default 1 min 1 max " << MAX_MULTI_PV << std::endl;
+        std::cout << "option name Move Overhead type spin default " << DEFAULT_MOVE_OVERHEAD << " min 0 max 5000" << std::endl;
+        std::cout << "option name HashFile type string default <empty>" << std::endl;
+        std::cout << "option name SharedHash type string default <empty>" << std::endl;
         std::cout << "uciok" << std::endl;
     } else if (cmd == "isready") {
         // Respond to the "isready" command by indicating that the engine is ready
+        std::lock_guard<std::mutex> output(skunk->io_mutex);
         std::cout << "readyok" << std::endl;
     } else if (cmd.substr(0, 9) == "setoption") {
         // Parse and process any options sent with the "setoption" command
-        // ...
+        skunk->parse_setoption(cmd);
     } else if (cmd.substr(0, 8) == "position") {
         // Parse and set the position on the board sent with the "position" command
         skunk->parse_position(cmd);
@@ -143,25 +203,43 @@ void parse_command(const std::string& cmd, Skunk* skunk) {
         // Start the search and print the best move when it is finished
         skunk->parse_go(cmd);
     } else if (cmd.substr(0, 10) == "ucinewgame") {
+        // nothing from the last game should carry over. The clear finishes before the next command, so
+        // "isready" is only answered once the table is empty. A shared table is left alone, other
+        // processes are still using it, and so is a file backed one, which is kept to outlive the game
+        if (!skunk->tt.is_shared() && !skunk->tt.is_file_backed()) skunk->tt.clear();
         skunk->parse_position("position startpos");
+    } else if (cmd == "ponderhit") {
+        skunk->ponderhit();
     } else if (cmd == "stop") {
         // Stop the search in response to the "stop" command
-        // ...
+        skunk->stop_search();
     } else if (cmd == "quit") {
         // Exit the program in response to the "quit" command
         exit(0);
+    } else if (cmd.substr(0, 9) == "savehash ") {
+        std::string path = cmd.substr(9);
+        bool saved = skunk->tt.save(path.c_str());
+        std::cout << "info string " << (saved ? "saved hash to " : "could not save hash to ") << path << std::endl;
+    } else if (cmd.substr(0, 9) == "loadhash ") {
+        std::string path = cmd.substr(9);
+        bool loaded = skunk->tt.load(path.c_str());
+        std::cout << "info string " << (loaded ? "loaded hash from " : "could not load hash from ") << path << ", Hash " << skunk->tt.megabytes << " MB" << std::endl;
     } else if (cmd.substr(0, 5) == "perft") {
         skunk->parse_perft(cmd);
     } else if (cmd == "board") {
         t_moves moves;
-        skunk->generate_moves(moves);
-        skunk->print_board();
-        skunk->sort_moves(moves.moves, moves.count);
-        skunk->print_moves(moves);
+        skunk->position.generate_moves(moves);
+        skunk->position.print_board();
+        skunk->threads[0]->pos = skunk->position;
+        skunk->threads[0]->sort_moves(moves.moves, moves.count);
+        skunk->threads[0]->print_moves(moves);
     } else if (cmd == "score") {
-        std::cout << skunk->evaluate() << std::endl;
+        std::cout << skunk->position.evaluate() << std::endl;
     } else if (cmd == "sort") {
-        skunk->show_sort();
+        skunk->threads[0]->pos = skunk->position;
+        skunk->threads[0]->show_sort();
+    } else if (cmd == "sliderbench") {
+        skunk->position.bench_slider_attacks(10000000);
     }
 }
 
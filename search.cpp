@@ -0,0 +1,1264 @@
+#include "search.h"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <map>
+
+
+/*****************************\
+===============================
+         search thread
+===============================
+\*****************************/
+
+SearchThread::SearchThread(Skunk *engine, TranspositionTable *tt, int id) : id(id), engine(engine), tt(tt) {
+    pos.clear();
+    repitition.count = 0;
+    previous_pv_line.cmove = 0;
+    init_heuristics();
+
+    worker = std::thread(&SearchThread::idle_loop, this);
+    wait_for_search_finished();
+}
+
+SearchThread::~SearchThread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exiting = true;
+        searching = true;
+    }
+    condition.notify_all();
+    worker.join();
+}
+
+// the worker parks here between searches. The main thread's worker runs the whole engine search (which
+// wakes the helpers and reports the best move), a helper's only its own iterative deepening
+void SearchThread::idle_loop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        searching = false;
+        condition.notify_all();
+        condition.wait(lock, [this] { return searching; });
+        if (exiting) return;
+        lock.unlock();
+
+        if (id == 0) engine->run_search(max_depth);
+        else search(max_depth);
+    }
+}
+
+void SearchThread::start_searching(int max_depth) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->max_depth = max_depth;
+        searching = true;
+    }
+    condition.notify_all();
+}
+
+void SearchThread::wait_for_search_finished() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !searching; });
+}
+
+void SearchThread::print_moves(t_moves &moves_list)
+{
+    printf("%-9s %-6s %-8s %-7s %-9s %-9s %-9s\n","num", "source", "target", "piece", "score", "enpassant", "castle");
+
+    for (int i=0; i<moves_list.count; i++)
+    {
+        int move = moves_list.moves[i];
+        printf("%-9d %-6s %-8s %-7c %-9d %-9d %-9d\n",
+               move,
+               tables.square_to_coordinate[decode_source(move)],
+               tables.square_to_coordinate[decode_destination(move)],
+               ascii_pieces[decode_piece(move)],
+               score_move(move),
+               decode_enpassant(move),
+               decode_castle(move)
+               );
+    }
+    printf("Total of %d moves.\n", moves_list.count);
+}
+
+void SearchThread::init_heuristics() {
+    // Initialize the search stack and history table
+    for (SearchStack &entry : stack) {
+        entry = {.move = 0, .static_eval = NO_EVAL, .killers = {-1, -1}, .pv_move = 0, .excluded_move = 0, .in_check = false};
+    }
+    for (int piece = P; piece <= k; ++piece) {
+        for (int square = 0; square < 64; ++square) {
+            history_table[piece][square] = 0;
+        }
+    }
+}
+
+// Update the killer moves and history table
+void SearchThread::update_heuristics(int ply, int move, int depth) {
+    // Update killer moves
+    int *killers = stack_at(ply)->killers;
+    if (move != killers[0]) {
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+
+    // Update history table
+    int piece = decode_piece(move);
+    int destination = decode_destination(move);
+    history_table[piece][destination] += depth * depth;
+}
+
+void SearchThread::sort_moves(int *moves, int num_moves) {
+
+    std::sort(moves, moves + num_moves, [&](const int &a, const int &b) {
+
+        int a_score = score_move(a);
+        int b_score = score_move(b);
+
+        return a_score > b_score;
+    });
+}
+
+int SearchThread::score_move(int move) {
+
+    int score = 0;
+
+    // the previous principal variation goes first
+    if (move == stack_at(ply)->pv_move) {
+        score += 20000;
+    }
+   
+    // consult the lookup table
+    int piece = decode_piece(move);
+    int destination = decode_destination(move);
+    int victim = pos.get_piece(destination);
+    
+    if (decode_promoted(move)) {
+        // we want to check promotions high as well
+        score += 5000;
+    }
+
+    // if it is a capture, use a piece victim lookup table
+    // if (pos.is_capture(move)) {
+    //     score += tables.mvv_lva[piece][victim] * 100;
+    // } 
+
+    // if it is a capture, use a piece victim lookup table
+    if (pos.is_capture(move)) {
+        score += tables.mvv_lva[piece][victim] * 100;
+        // Adjust capture score based on SEE value
+        int see_value = pos.see(move);
+        score += see_value * 10;
+    }
+
+#ifdef KILLER_HISTORY
+    // Killer moves
+    const int *killers = stack_at(ply)->killers;
+    if (move == killers[0]) {
+        score += 9000;
+    } else if (move == killers[1]) {
+        score += 8000;
+    }
+
+    // History heuristic
+    score += history_table[piece][decode_destination(move)];
+#endif
+
+    return score;
+}
+
+// static evaluation of pos, through the thread's eval cache
+int SearchThread::evaluate() {
+    int score;
+    eval_probes++;
+    if (eval_cache.probe(pos.zobrist, score)) {
+        eval_hits++;
+        return score;
+    }
+    score = pos.evaluate(&pawn_table);
+    eval_cache.store(pos.zobrist, score);
+    return score;
+}
+
+// Start loading everything the child of move will look up while the move is still being made: its table
+// bucket, its eval cache slot and, when a pawn moves or is taken, its pawn hash entry
+void SearchThread::prefetch_child(int move) {
+    U64 key = pos.key_after(move);
+    #ifdef TRANSPOSITION_TABLE
+    tt->prefetch(key);
+    #endif
+    eval_cache.prefetch(key);
+
+    U64 pawn_key = pos.pawn_key_after(move);
+    if (pawn_key != pos.pawn_key) pawn_table.prefetch(pawn_key);
+}
+
+// checked at every node, so a node limited search stops at the same node every time it is run. Depth 1 is
+// always finished, so there is a move to report however small the budget
+inline bool SearchThread::out_of_nodes() const {
+    return id == 0 && engine->node_limit && completed_depth && nodes + q_nodes >= engine->node_limit;
+}
+
+int SearchThread::quiesence(int alpha, int beta) {
+    q_nodes++;
+    if (out_of_nodes()) engine->force_stop = true;
+    if (engine->force_stop) return 0;
+
+    // Check if the king is in check
+    int check = pos.is_check();
+
+    // quiescence entries sit below every main search depth, so they only replace shallow slots
+    int tt_depth = check ? QS_CHECK_DEPTH : QS_DEPTH;
+    int original_alpha = alpha;
+
+    TTData entry;
+    bool tt_hit = tt->probe(pos.zobrist, entry);
+    if (tt_hit) {
+        entry.value = value_from_tt(entry.value, ply);
+        if (entry.depth >= tt_depth) {
+            if (entry.type == EXACT
+                || (entry.type == LOWER_BOUND && entry.value >= beta)
+                || (entry.type == UPPER_BOUND && entry.value <= alpha)) {
+                cache_hit++;
+                return entry.value;
+            }
+        }
+    }
+
+    // Generate all legal moves
+    t_moves moves_list;
+    pos.generate_moves(moves_list);
+
+    // Calculate the evaluation score, the table may already have it
+    int evaluation = tt_hit && entry.eval != NO_EVAL ? entry.eval : evaluate();// + static_cast<int>(log(moves_list.count + 1) * 0.5 * MOBILITY_WEIGHT) - (check ? KING_SAFETY_WEIGHT : 0);
+    
+
+    // Alpha-beta pruning
+    if (evaluation >= beta) {
+        #ifdef TRANSPOSITION_TABLE
+        if (!tt_hit) tt->store(pos.zobrist, value_to_tt(evaluation, ply), evaluation, tt_depth, 0, LOWER_BOUND);
+        #endif
+        return evaluation;
+    }
+
+    if (evaluation > alpha) {
+        alpha = evaluation;
+    }
+
+    // Sort the moves to improve search efficiency, a capture hash move goes first
+    int ordered = 0;
+    if (tt_hit && entry.move) {
+        for (int i = 0; i < moves_list.count; i++) {
+            if (pack_move(moves_list.moves[i]) == entry.move) {
+                std::swap(moves_list.moves[0], moves_list.moves[i]);
+                ordered = pos.is_capture(moves_list.moves[0]);
+                break;
+            }
+        }
+    }
+    sort_moves(moves_list.moves + ordered, moves_list.count - ordered);
+
+    int score = INT_MIN, best_move = 0;
+
+    bool made_capture = false;
+
+    for (int i = 0; i < moves_list.count; i++) {
+        int move = moves_list.moves[i];
+
+        // Only consider capture moves in quiescence search
+        if (!pos.is_capture(move)) continue;
+
+        int victim = pos.get_piece(decode_destination(move));
+
+        #ifdef FUTILITY_PRUNE
+        // // Futility pruning: skip moves that are unlikely to improve the position
+        // if (!pos.is_check() && (abs(piece_scores[victim]) + evaluation + piece_scores[Q] * 10) < alpha) {
+        //     return alpha;
+        // }
+        // Futility pruning: skip moves that are unlikely to improve the position
+        int futility_margin = 100; // Adjust this value based on your engine's requirements
+        if (!pos.is_check() && (evaluation + piece_scores[victim] + futility_margin <= alpha)) {
+            continue;
+        }
+        #endif
+
+        
+
+        // Keep track of whether a capture move was made
+        made_capture = true;
+
+        // Copy the board
+        copy_board(pos);
+
+        prefetch_child(move);
+
+        // Make the move on the board
+        pos.make_move(move, only_captures);
+
+        // Recursively call quiescence search with negamax
+        int test = -quiesence(-beta, -alpha);
+
+        // Restore the board to its previous state
+        restore_board(pos);
+
+        // a stopped child returns 0, which must not reach the bounds or the table
+        if (engine->force_stop) return 0;
+
+        // Update the best score
+        score = std::max(score, test);
+
+        // Alpha-beta pruning
+        if (score >= beta) {
+            #ifdef TRANSPOSITION_TABLE
+            tt->store(pos.zobrist, value_to_tt(beta, ply), evaluation, tt_depth, move, LOWER_BOUND);
+            #endif
+            return beta;
+        }
+
+        if (score > alpha) {
+            alpha = score;
+            best_move = move;
+        }
+    }
+
+    // If no legal capture moves and the king is in check, this is a checkmate
+    if (!made_capture && check) {
+        return -CHECKMATE + ply;
+    }
+
+    #ifdef TRANSPOSITION_TABLE
+    tt->store(pos.zobrist, value_to_tt(alpha, ply), evaluation, tt_depth, best_move, alpha > original_alpha ? EXACT : UPPER_BOUND);
+    #endif
+
+    return alpha;
+}
+
+bool SearchThread::should_do_null_move() {
+    /* should NOT do null move if 
+    the side to move has only its king and pawns remaining
+    the side to move has a small number of pieces remaining
+    the previous move in the search was also a null move.
+    */
+
+    int num_major;
+    // count the number of major pieces
+    if (pos.side == white) {
+        num_major = pos.piece_count[B] + pos.piece_count[R] + pos.piece_count[Q] + pos.piece_count[N];
+    } else {
+        num_major = pos.piece_count[b] + pos.piece_count[r] + pos.piece_count[q] + pos.piece_count[n];
+    }
+
+
+    // side to move has too few of pieces
+    // if (num_major <= 3) return false;
+
+    return true;
+}
+
+// new negamax
+template <NodeType node>
+int SearchThread::negamax(int alpha, int beta, int depth, int verify, int do_null) {
+    constexpr bool root_node = node == ROOT;
+    constexpr bool pv_node = node != NON_PV;
+    // a PV node's first move keeps the open window, every other child is a zero window search first
+    constexpr NodeType child = pv_node ? PV : NON_PV;
+
+    int best_move = 0, current_move, best_score = -INT_MAX, current_score, null_move_score;
+    bool fail_high = false, check = false;
+    SearchStack *ss = stack_at(ply);
+
+    if constexpr (pv_node) pv_length[ply] = 0;
+
+    nodes++;
+
+    if (out_of_nodes()) engine->force_stop = true;
+    if (engine->force_stop) return 0;
+
+    if constexpr (!root_node) {
+        // the line cannot get any longer, which only very deep "go infinite" searches reach
+        if (ply >= MAX_PLY - 1) return evaluate();
+
+        if (depth < 1) {
+            return quiesence(alpha, beta);
+        }
+
+        if (is_repetition()) {
+            return -evaluate() * 0.25;
+        }
+    }
+
+    // Transposition table lookup
+    TTData entry;
+    bool tt_hit = tt->probe(pos.zobrist, entry);
+    if (tt_hit) entry.value = value_from_tt(entry.value, ply);
+
+    // a node that leaves moves out (the lines already found at a MultiPV root, or the stack's excluded move)
+    // is not the position the table knows about
+    bool excluding = (root_node && pv_index > 0) || ss->excluded_move;
+
+    // only zero window nodes take table cutoffs. A PV node that returned a stored score would leave its line (and
+    // the ponder move) empty from here down, so it is always searched and the table only orders its moves.
+    if constexpr (!pv_node) {
+        if (tt_hit && !verify && entry.depth >= depth) {
+            if (entry.type == EXACT) {
+                cache_hit++;
+                return entry.value;
+            } else if (entry.type == LOWER_BOUND) {
+                alpha = std::max(alpha, (entry.value));
+            } else if (entry.type == UPPER_BOUND) {
+                beta = std::min(beta, (entry.value));
+            }
+            if (alpha >= beta) {
+                cache_hit++;
+                return entry.value;
+            }
+        }
+    }
+
+    int original_alpha = alpha;
+
+    t_moves moves_list;
+    moves_list.count = -1;
+    pos.generate_moves(moves_list);
+
+    // the hash move goes first, the rest are sorted as usual. Matching on the packed move also throws away
+    // moves from key collisions that are not legal here.
+    int ordered = 0;
+    if (tt_hit && entry.move) {
+        for (int i = 0; i < moves_list.count; i++) {
+            if (pack_move(moves_list.moves[i]) == entry.move) {
+                std::swap(moves_list.moves[0], moves_list.moves[i]);
+                ordered = 1;
+                break;
+            }
+        }
+    }
+    sort_moves(moves_list.moves + ordered, moves_list.count - ordered);
+
+    check = pos.is_check();
+
+    if (moves_list.count == 0) {
+        return check ? (-CHECKMATE) + ply : 0;
+    }
+
+    // always a fresh evaluation, never the eval a table entry happened to keep
+    ss->in_check = check;
+    ss->static_eval = check ? NO_EVAL : evaluate();
+
+    if (check) depth++;
+
+    // Null move pruning, only in zero window nodes. A PV node is searched for its exact score and line, which a
+    // null move fail high would throw away
+    if constexpr (!pv_node) {
+        if (!check && do_null == DO_NULL && (!verify || depth > 1)) {
+            copy_board(pos);
+            pos.side ^= 1;
+            pos.zobrist ^= zobrist_keys.side_key;
+            if (pos.enpassant != no_square) {
+                pos.zobrist ^= zobrist_keys.enpassant_keys[pos.enpassant];
+            }
+            pos.enpassant = no_square;
+
+            ss->move = 0;
+            ply++;
+
+            null_move_score = -negamax<NON_PV>(-beta, -beta + 1, depth - 1 - NULL_R, verify, NO_NULL);
+
+            ply--;
+            restore_board(pos);
+
+            if (null_move_score >= beta) {
+                if (verify) {
+                    depth--;
+                    verify = false;
+                    fail_high = true;
+                } else {
+                    return null_move_score;
+                }
+            }
+        }
+    }
+
+    copy_board(pos);
+    int searched_moves = 0;
+
+    for (int i = 0; i < moves_list.count; i++) {
+        current_move = moves_list.moves[i];
+        if (excluding && (current_move == ss->excluded_move || (root_node && excluded_at_root(current_move)))) continue;
+
+        prefetch_child(current_move);
+        ss->move = current_move;
+        if constexpr (pv_node) pv_length[ply + 1] = 0;
+        pos.make_move(current_move, all_moves);
+        ply++;
+        repitition.table[repitition.count++] = pos.zobrist;
+
+        re_search:
+        // Apply PVS and LMR
+        if (searched_moves == 0) {
+            current_score = -negamax<child>(-beta, -alpha, depth - 1, verify, DO_NULL);
+        } else {
+            if (searched_moves >= LMR_DEPTH && depth >= LMR_MIN_DEPTH && !check && !pos.is_capture(current_move) && decode_promoted(current_move) == 0) {
+                // Apply LMR
+                current_score = -negamax<NON_PV>(-alpha - 1, -alpha, depth - 1 - LMR_REDUCTION, verify, NO_NULL);
+
+                // a zero window node has nothing between alpha and beta to re-search for
+                if (pv_node && current_score > alpha && current_score < beta) {
+                    // Re-search with full depth, as the move is better than expected
+                    current_score = -negamax<child>(-beta, -alpha, depth - 1, verify, DO_NULL);
+                }
+            } else {
+                // Apply PVS
+                current_score = -negamax<NON_PV>(-alpha - 1, -alpha, depth - 1, verify, NO_NULL);
+
+                if (pv_node && current_score > alpha && current_score < beta) {
+                    // Re-search with full window, as the move is better than expected
+                    current_score = -negamax<PV>(-beta, -alpha, depth - 1, verify, DO_NULL);
+                }
+            }
+        }
+
+        // Check for best score and move
+        if (current_score > best_score) {
+            best_score = current_score;
+            best_move = current_move;
+        }
+
+        // Null move verification re-check if no beta cut-off was found
+        if (fail_high && current_score < beta) {
+            depth++;
+            fail_high = false;
+            verify = true;
+            goto re_search;
+        }
+
+        restore_board(pos);
+        ply--;
+        repitition.count--;
+        searched_moves++;
+
+        // a stopped child returns 0, which must not reach the table
+        if (engine->force_stop) return 0;
+
+        if (best_score > alpha) {
+            alpha = best_score;
+            if constexpr (pv_node) update_pv(current_move);
+
+            if (alpha >= beta) {
+                // Update killer moves and history here...
+                #ifdef KILLER_HISTORY
+                if (!pos.is_capture(current_move) && ply < MAX_PLY) {
+                    update_heuristics(ply, current_move, depth);
+                }
+                #endif
+
+                #ifdef TRANSPOSITION_TABLE
+                if (!excluding) tt->store(pos.zobrist, value_to_tt(beta, ply), NO_EVAL, depth, best_move, LOWER_BOUND);
+                #endif
+                return beta;
+            }
+        }
+    }
+
+    // Transposition table store
+    #ifdef TRANSPOSITION_TABLE
+    Bound type;
+    if (best_score <= original_alpha) {
+        type = UPPER_BOUND;
+    } else if (best_score >= beta) {
+        type = LOWER_BOUND;
+    } else {
+        type = EXACT;
+    }
+    if (!excluding) tt->store(pos.zobrist, value_to_tt(best_score, ply), NO_EVAL, depth, best_move, type);
+    #endif
+
+    return best_score;
+}
+
+
+
+
+
+// move is the new best at ply, the line continues with the best line found below it
+void SearchThread::update_pv(int move) {
+    pv_table[ply][0] = move;
+    memcpy(pv_table[ply] + 1, pv_table[ply + 1], pv_length[ply + 1] * sizeof(int));
+    pv_length[ply] = pv_length[ply + 1] + 1;
+}
+
+t_line SearchThread::root_pv() const {
+    // a root with no moves, or one stopped before its first move came back, gives an empty line with no best move
+    t_line line{};
+    line.cmove = pv_length[0];
+    memcpy(line.argmove, pv_table[0], pv_length[0] * sizeof(int));
+    return line;
+}
+
+// previous_pv_line and the stack's pv moves are what the next search of that line is ordered by
+void SearchThread::set_pv_moves(const t_line &line) {
+    previous_pv_line = line;
+    for (int i = 0; i < MAX_PLY; i++) {
+        stack_at(i)->pv_move = i < line.cmove ? line.argmove[i] : 0;
+    }
+}
+
+bool SearchThread::excluded_at_root(int move) const {
+    for (int i = 0; i < pv_index; i++) {
+        if (root_moves[i] == move) return true;
+    }
+    return false;
+}
+
+// one "info" line per line of the iteration, multipv 0 leaves the field out for a single line search. bound
+// is " lowerbound" or " upperbound" when the score is from an aspiration search that failed high or low
+void SearchThread::print_line(int multipv, int depth, const RootLine &root_line, long elapsed, const char *bound) {
+    int score = root_line.score;
+    printf("info ");
+    if (multipv) printf("multipv %d ", multipv);
+
+    if (score < -CHECKMATE + 2000) {
+        printf("transpositions %d ttp: %.4f score mate %d%s depth %d nodes %llu q_nodes %llu time %ld", cache_hit, ((float)cache_hit)/nodes, -(score + CHECKMATE) / 2 - 1, bound, depth, nodes, q_nodes, elapsed);
+    } else if (score > CHECKMATE - 2000) {
+        printf("transpositions %d ttp: %.4f score mate %d%s depth %d nodes %llu q_nodes %llu time %ld", cache_hit,((float)cache_hit)/nodes, (CHECKMATE - score) / 2 + 1, bound, depth, nodes, q_nodes, elapsed);
+    } else {
+        std::cout << "transpositions " << cache_hit << " pruned: " << null_move_pruned << " score cp " << score << bound << " depth " << depth << " nodes " << nodes << " time " << elapsed;
+    }
+
+    // a bound from the first search of a depth can come without any line at all, then there is no pv to give
+    if (root_line.line.cmove) std::cout << " pv";
+    for (int i = 0; i < root_line.line.cmove; i++) {
+        printf(" ");
+        tables.print_move(root_line.line.argmove[i]);
+    }
+    std::cout << std::endl;
+}
+
+// depth skipping patterns for the helper threads, helper i uses entry (i - 1) % 20
+static const int skip_size[20] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const int skip_phase[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// the top level call to get the best move
+int SearchThread::search(int maxDepth) {
+
+
+    // iterate through deepening as we go
+    t_line pline{};
+
+    int score;
+    cache_hit = 0;
+    q_nodes = 0;
+    nodes = 0;
+
+    null_move_pruned = 0;
+    eval_probes = 0;
+    eval_hits = 0;
+    pawn_table.probes = 0;
+    pawn_table.hits = 0;
+
+    int alpha = -INT_MAX, beta = INT_MAX;
+
+    best_move = 0;
+    best_score = 0;
+    completed_depth = 0;
+    long iteration_start = 0;
+
+    // nothing from the last search may be reported for this position
+    previous_pv_line.cmove = 0;
+
+    // searches without a depth limit still stop before the principal variation runs out of room
+    maxDepth = std::min(maxDepth, MAX_PLY - 1);
+
+    // MultiPV is the main thread's, the helpers search a single line and fill the table for it. There
+    // cannot be more lines than root moves
+    t_moves legal_moves;
+    pos.generate_moves(legal_moves);
+    int multi_pv = id == 0 ? std::max(1, std::min(engine->multi_pv, legal_moves.count)) : 1;
+    root_lines.clear();
+    pv_index = 0;
+
+    for (int depth = 0; depth < maxDepth; depth++) {
+
+        // Helpers skip some depths, each on its own pattern, so the threads spread over neighbouring
+        // depths instead of all searching the same tree in the same order
+        if (id > 0) {
+            int pattern = (id - 1) % 20;
+            if (((depth + 1 + skip_phase[pattern]) / skip_size[pattern]) % 2) continue;
+        }
+
+        init_heuristics();
+
+        // Search the root once per line, each time without the moves already found. The killers, history
+        // and table carry over from one line to the next, and every line is ordered by its own previous PV
+        std::vector<RootLine> lines;
+        for (pv_index = 0; pv_index < multi_pv; pv_index++) {
+            if (pv_index < (int) root_lines.size()) set_pv_moves(root_lines[pv_index].line);
+
+            // aspiration window around this line's last score, mates are searched with the full window
+            int delta = ASPIRATION_DELTA;
+            alpha = -INT_MAX;
+            beta = INT_MAX;
+            if (depth + 1 >= ASPIRATION_MIN_DEPTH && pv_index < (int) root_lines.size() && abs(root_lines[pv_index].score) < MATE_BOUND) {
+                alpha = root_lines[pv_index].score - delta;
+                beta = root_lines[pv_index].score + delta;
+            }
+
+            while (true) {
+                ply = 0;
+                score = negamax<ROOT>(alpha, beta, depth + 1, 1, DO_NULL);
+
+                if (engine->force_stop) break;
+                pline = root_pv();
+
+                // widen the side that failed and search again
+                const char *bound;
+                if (score <= alpha && alpha > -INT_MAX) {
+                    bound = " upperbound";
+                    alpha = std::max(score - delta, -INT_MAX);
+                } else if (score >= beta && beta < INT_MAX) {
+                    bound = " lowerbound";
+                    beta = std::min(score + delta, INT_MAX);
+                } else {
+                    break;
+                }
+                delta *= 2;
+                if (delta > CHECKMATE) {
+                    alpha = -INT_MAX;
+                    beta = INT_MAX;
+                }
+
+                if (id == 0) {
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - engine->start_time).count();
+                    std::lock_guard<std::mutex> output(engine->io_mutex);
+                    // a fail low leaves no line of its own, the last iteration's is the best guess until the re-search
+                    t_line shown = pline;
+                    if (!shown.cmove && pv_index < (int) root_lines.size()) shown = root_lines[pv_index].line;
+                    print_line(multi_pv > 1 ? pv_index + 1 : 0, depth + 1, {score, shown}, elapsed, bound);
+                }
+            }
+
+            if (engine->force_stop) break;
+
+            root_moves[pv_index] = pline.argmove[0];
+            lines.push_back({score, pline});
+        }
+        pv_index = 0;
+
+        if (engine->force_stop) {
+            // the PV the best move and ponder move are read from is the last completed one
+            if (!root_lines.empty()) previous_pv_line = root_lines[0].line;
+            break;
+        }
+
+        // a later line can come out ahead of an earlier one when the search is unstable
+        std::stable_sort(lines.begin(), lines.end(), [](const RootLine &a, const RootLine &b) { return a.score > b.score; });
+        root_lines = lines;
+
+        // copy this pline to the previous pline struct so we can use it in next search
+        memcpy(&previous_pv_line, &root_lines[0].line, sizeof(t_line));
+        score = root_lines[0].score;
+        best_move = previous_pv_line.argmove[0];
+        best_score = score;
+        completed_depth = depth + 1;
+
+        // only the main thread talks to the GUI and watches the clock
+        if (id != 0) continue;
+
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - engine->start_time).count();
+        bool out_of_time = engine->time_manager.should_stop(elapsed, elapsed - iteration_start, best_move, score) && !engine->pondering;
+        iteration_start = elapsed;
+
+        // "go mate" is done as soon as a mate in that many moves is found
+        bool found_mate = engine->mate_limit && score > CHECKMATE - 2000 && (CHECKMATE - score) / 2 + 1 <= engine->mate_limit;
+
+        std::lock_guard<std::mutex> output(engine->io_mutex);
+
+        // print each line for each depth
+        for (int i = 0; i < (int) root_lines.size(); i++) {
+            print_line(multi_pv > 1 ? i + 1 : 0, depth + 1, root_lines[i], elapsed);
+        }
+
+        if (out_of_time || found_mate) break;
+    }
+
+    if (id == 0) {
+        std::lock_guard<std::mutex> output(engine->io_mutex);
+        printf("info string eval cache %d hits of %d probes (%.1f%%)\n", eval_hits, eval_probes, eval_probes ? 100.0 * eval_hits / eval_probes : 0.0);
+        printf("info string pawn hash %d hits of %d probes (%.1f%%)\n", pawn_table.hits, pawn_table.probes, pawn_table.probes ? 100.0 * pawn_table.hits / pawn_table.probes : 0.0);
+    }
+
+    return previous_pv_line.argmove[0];
+}
+
+
+int SearchThread::is_repetition() {
+    for (int i = repitition.count-2; i>=0; i--) {
+        if (repitition.table[i] == pos.zobrist) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void SearchThread::show_sort() {
+    t_moves moves_list;
+    pos.generate_moves(moves_list);
+    printf("Moves before sort:\n");
+    for (int i=0; i<moves_list.count; i++) {
+        tables.print_move(moves_list.moves[i]);
+        printf("\n");
+    }
+    sort_moves(moves_list.moves, moves_list.count);
+    printf("After sort:\n");
+    for (int i=0; i<moves_list.count; i++) {
+        tables.print_move(moves_list.moves[i]);
+        printf("\n");
+    }
+}
+
+/*****************************\
+===============================
+         time manager
+===============================
+\*****************************/
+
+void TimeManager::init(int time, int increment, int moves_to_go, int overhead) {
+    // sudden death is planned as if 40 moves remain, so the budget shrinks with the clock
+    int horizon = moves_to_go > 0 ? std::min(moves_to_go, 50) : 40;
+    int remaining = std::max(1, time - overhead);
+
+    // the time we can spend on the next horizon moves, keeping one overhead back for each of them. On a short
+    // clock that reserve alone would eat everything, so it never takes more than half of what is left
+    int reserve = std::min(overhead * (horizon - 1), remaining / 2);
+    int budget = std::max(1, remaining + increment * (horizon - 1) - reserve);
+
+    // never plan to use more than most of what is on the clock, with the last move before the control
+    // allowed a little more of it
+    maximum = std::max(1, (int) std::min<long>((long) budget / horizon * 5, remaining * (horizon == 1 ? 0.9 : 0.7)));
+    optimum = std::max(1, std::min(budget / horizon, maximum));
+
+    enabled = true;
+    origin = 0;
+    best_move_changes = 0;
+    previous_best_move = 0;
+    previous_score = 0;
+}
+
+// "go movetime" uses all of it, less the overhead
+void TimeManager::init_fixed(int move_time, int overhead) {
+    enabled = false;
+    origin = 0;
+    optimum = maximum = std::max(1, move_time - overhead);
+}
+
+void TimeManager::disable() {
+    enabled = false;
+    optimum = maximum = 0;
+}
+
+bool TimeManager::should_stop(long elapsed, long iteration_time, int best_move, int score) {
+    if (!enabled) return false;
+    elapsed -= origin;
+
+    // recent changes of mind weigh more than old ones
+    best_move_changes = best_move_changes / 2 + (previous_best_move && best_move != previous_best_move);
+    double scale = 0.75 + best_move_changes * 0.6;
+
+    // a falling score means the position is harder than it looked, spend more
+    if (previous_best_move && score < previous_score - 30) scale *= 1.3;
+
+    previous_best_move = best_move;
+    previous_score = score;
+
+    if (elapsed >= std::min<double>(optimum * std::min(scale, 2.5), maximum)) return true;
+
+    // the next iteration usually takes a few times as long as this one, do not start what cannot finish
+    return elapsed + iteration_time * 2 > maximum;
+}
+
+/*****************************\
+===============================
+            engine
+===============================
+\*****************************/
+
+Skunk::Skunk() {
+    threads.push_back(new SearchThread(this, &tt, 0));
+    parse_fen(fen_start);
+}
+
+Skunk::~Skunk() {
+    force_stop = true;
+    wait_for_search();
+    for (SearchThread *thread : threads) delete thread;
+}
+
+// sets up the game position only; keys and tables are static and the heuristics are reset by the search itself.
+// A malformed fen changes nothing, the previous game stays set up.
+bool Skunk::parse_fen(const std::string& fen) {
+    if (!position.parse_fen(fen)) return false;
+    repitition.count = 0;
+    game_base.clear();
+    game_moves.clear();
+    return true;
+}
+
+// Threads are created and destroyed only here, searches wake the parked helpers instead
+void Skunk::set_threads(int count) {
+    count = std::clamp(count, 1, MAX_THREADS);
+    while ((int) threads.size() > count) {
+        delete threads.back();
+        threads.pop_back();
+    }
+    while ((int) threads.size() < count) {
+        threads.push_back(new SearchThread(this, &tt, (int) threads.size()));
+    }
+}
+
+/*
+ * Each thread votes for the move of its deepest completed iteration, weighted by that depth and by how far
+ * its score is above the worst one. The main thread wins ties, so with one thread this is just its result.
+ */
+SearchThread *Skunk::pick_best_thread() {
+    std::map<int, long> votes;
+    int min_score = INT_MAX;
+    for (SearchThread *thread : threads) {
+        if (thread->completed_depth) min_score = std::min(min_score, thread->best_score);
+    }
+    for (SearchThread *thread : threads) {
+        if (!thread->completed_depth || !thread->best_move) continue;
+        votes[thread->best_move] += (long) (thread->best_score - min_score + 14) * thread->completed_depth;
+    }
+
+    SearchThread *best = threads[0];
+    for (SearchThread *thread : threads) {
+        if (!thread->completed_depth || !thread->best_move) continue;
+        if (!best->best_move || votes[thread->best_move] > votes[best->best_move]) best = thread;
+    }
+    return best;
+}
+
+// runs on the main thread's worker: searches with every thread and reports the best move
+void Skunk::run_search(int maxDepth) {
+    tt.new_search();
+    if (time_manager.maximum > 0) start_timer();
+
+    // every search thread works on its own copy of the game
+    for (SearchThread *thread : threads) {
+        thread->pos = position;
+        thread->repitition = repitition;
+    }
+
+    for (size_t i = 1; i < threads.size(); i++) threads[i]->start_searching(maxDepth);
+    threads[0]->search(maxDepth);
+
+    // an infinite search waits for "stop", a ponder search may not report before the GUI says whether the opponent played the predicted move
+    {
+        std::unique_lock<std::mutex> lock(timer_mutex);
+        timer_condition.wait(lock, [this] { return !(pondering || infinite) || force_stop; });
+    }
+
+    // the helpers search until the main thread is done
+    force_stop = true;
+    for (size_t i = 1; i < threads.size(); i++) threads[i]->wait_for_search_finished();
+    stop_timer();
+
+    // the helpers search a single line, so a MultiPV search reports the main thread's lines
+    SearchThread *best = multi_pv > 1 ? threads[0] : pick_best_thread();
+    int best_move = best->best_move;
+    if (!best_move) {
+        // stopped before any iteration finished, any legal move beats none
+        t_moves moves;
+        position.generate_moves(moves);
+        if (moves.count) best_move = moves.moves[0];
+    }
+    // the reply we expect, for the GUI to ponder on
+    int ponder_move = best->previous_pv_line.cmove > 1 && best->previous_pv_line.argmove[0] == best_move ? best->previous_pv_line.argmove[1] : 0;
+
+    std::lock_guard<std::mutex> output(io_mutex);
+    long long requested = stop_requested;
+    if (requested) {
+        long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        printf("info string stop latency %lld us\n", (now - requested) / 1000);
+    }
+    printf("bestmove ");
+    // checkmate or stalemate at the root leaves nothing to play
+    if (best_move) tables.print_move(best_move);
+    else printf("0000");
+    if (ponder_move) {
+        printf(" ponder ");
+        tables.print_move(ponder_move);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    last_best_move = best_move;
+}
+
+// the top level call to get the best move, blocks until the search is over
+int Skunk::search(int maxDepth) {
+    start_search(maxDepth);
+    wait_for_search();
+    return last_best_move;
+}
+
+// hands the search to the main thread's worker and returns straight away, so the UCI loop keeps reading.
+// The stop flag is reset here rather than on the worker so a "stop" sent right after "go" is not lost
+void Skunk::start_search(int maxDepth) {
+    wait_for_search();
+    start_time = std::chrono::steady_clock::now();
+    force_stop = false;
+    stop_requested = 0;
+    threads[0]->start_searching(maxDepth);
+}
+
+void Skunk::wait_for_search() {
+    threads[0]->wait_for_search_finished();
+}
+
+// the "stop" command, the search prints its best move as soon as every thread has unwound
+void Skunk::stop_search() {
+    stop_requested = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    force_stop = true;
+    pondering = false;
+    timer_condition.notify_all();
+}
+
+// Raises force_stop at the deadline, unless stop_timer gets there first. A ponder search starts without a
+// deadline and gets one on "ponderhit".
+void Skunk::start_timer() {
+    stop_timer();
+    timer_cancelled = false;
+    has_deadline = !pondering;
+    deadline = start_time + std::chrono::milliseconds(time_manager.maximum);
+    timer = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(timer_mutex);
+        while (!timer_cancelled) {
+            if (has_deadline && std::chrono::steady_clock::now() >= deadline) {
+                force_stop = true;
+                timer_condition.notify_all();
+                break;
+            }
+            if (has_deadline) timer_condition.wait_until(lock, deadline);
+            else timer_condition.wait(lock);
+        }
+    });
+}
+
+void Skunk::stop_timer() {
+    if (!timer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex);
+        timer_cancelled = true;
+    }
+    timer_condition.notify_all();
+    timer.join();
+}
+
+// The opponent played the move we pondered on. The search carries on with everything it has found, but
+// from now on it runs on our clock.
+void Skunk::ponderhit() {
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    auto now = std::chrono::steady_clock::now();
+    time_manager.origin = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count();
+    deadline = now + std::chrono::milliseconds(time_manager.maximum);
+    has_deadline = time_manager.maximum > 0;
+    pondering = false;
+    timer_condition.notify_all();
+}
+
+void Skunk::parse_go(const std::string& cmd) {
+    pondering = false;
+    infinite = false;
+    node_limit = 0;
+    mate_limit = 0;
+    search_depth = 0;
+    move_time = 0;
+    btime = 0;
+    wtime = 0;
+    binc = 0;
+    winc = 0;
+    moves_to_go = 0;
+
+    // a clock that has run out still reads as 0, so whether one was sent is kept apart from its value
+    bool clock = false;
+
+    std::stringstream ss(cmd);
+    std::string token;
+    while (ss >> token) {
+        if (token == "depth") {
+            ss >> search_depth;
+        } else if (token == "movetime") {
+            ss >> move_time;
+        } else if (token == "wtime") {
+            ss >> wtime;
+            clock = true;
+        } else if (token == "btime") {
+            ss >> btime;
+            clock = true;
+        } else if (token == "winc") {
+            ss >> winc;
+        } else if (token == "binc") {
+            ss >> binc;
+        } else if (token == "movestogo") {
+            ss >> moves_to_go;
+        } else if (token == "ponder") {
+            pondering = true;
+        } else if (token == "infinite") {
+            infinite = true;
+        } else if (token == "nodes") {
+            ss >> node_limit;
+        } else if (token == "mate") {
+            ss >> mate_limit;
+        }
+    }
+
+    int time = position.side == white ? wtime : btime;
+    int increment = position.side == white ? winc : binc;
+
+    // a bare "go" has nothing to stop it either, so it is searched as "go infinite"
+    if (!move_time && !search_depth && !clock && !node_limit && !mate_limit) infinite = true;
+
+    // Check which type of search to do. The node and mate limits apply on top of any of these
+    if (move_time > 0) {
+        time_manager.init_fixed(move_time, move_overhead);
+    } else if (search_depth > 0 || infinite) {
+        // Do a depth-limited (or unlimited) search
+        time_manager.disable();
+    } else if (clock) {
+        // a GUI reports an overstepped clock as negative, which is planned like an empty one
+        time_manager.init(std::max(time, 0), increment, moves_to_go, move_overhead);
+    } else {
+        time_manager.disable();
+    }
+    start_search(search_depth > 0 ? search_depth : INT_MAX);
+}
+
+
+void Skunk::parse_position(const std::string& command) {
+    /*
+     * command looks something like "position startpos" or "position fen <fen>"
+     */
+    std::string cmd = command.substr(9);
+
+    size_t moves_pos = cmd.find("moves");
+
+    // everything before "moves" identifies the starting position
+    std::string base = cmd.substr(0, moves_pos);
+    base.erase(base.find_last_not_of(' ') + 1);
+
+    std::vector<std::string> moves;
+    if (moves_pos != std::string::npos) {
+        std::stringstream moves_ss(cmd.substr(moves_pos + 5));
+        std::string move_str;
+        while (moves_ss >> move_str) {
+            moves.push_back(move_str);
+        }
+    }
+
+    // GUIs resend the whole game before every search. When the new move list only extends the game we already
+    // have, keep the current position and play just the new moves instead of replaying from the start.
+    size_t played = 0;
+    if (base == game_base && moves.size() >= game_moves.size() && std::equal(game_moves.begin(), game_moves.end(), moves.begin())) {
+        played = game_moves.size();
+    } else {
+        std::string fen = fen_start;
+        size_t fen_pos = base.find("fen");
+        if (base.substr(0, 8) != "startpos" && fen_pos != std::string::npos) {
+            fen = fen_pos + 4 < base.size() ? base.substr(fen_pos + 4) : "";
+        }
+        // the moves belong to the position that was rejected, so none of them are played either
+        if (!parse_fen(fen)) {
+            printf("info string invalid fen \"%s\", keeping the previous position\n", fen.c_str());
+            return;
+        }
+        game_base = base;
+    }
+
+    for (size_t i = played; i < moves.size(); i++) {
+        int move = parse_move(moves[i]);
+
+        if (move == 0) break;
+
+        position.make_move(move, all_moves);
+        repitition.table[repitition.count++] = position.zobrist;
+        game_moves.push_back(moves[i]);
+    }
+}
+
+
+
+
+int Skunk::parse_move(const std::string& move_string) {
+    if (move_string.length() < 4) return 0;
+
+    int source_file = move_string[0] - 'a', source_rank = move_string[1] - '0';
+    int target_file = move_string[2] - 'a', target_rank = move_string[3] - '0';
+    if (source_file < 0 || source_file > 7 || source_rank < 1 || source_rank > 8 ||
+        target_file < 0 || target_file > 7 || target_rank < 1 || target_rank > 8) return 0;
+
+    int source = source_file + (8 - source_rank) * 8;
+    int target = target_file + (8 - target_rank) * 8;
+    char promotion = move_string.length() > 4 ? move_string[4] : 0;
+
+    return position.encode_legal_move(source, target, promotion);
+}
+
+
+void Skunk::parse_perft(const std::string& command) {
+    int depth = 5;
+    std::string depth_str = command.substr(6); // Extract the depth substring
+    depth = std::stoi(depth_str); // Convert the depth substring to an integer
+    position.perft_test(depth);
+}
+
+
+
+// setoption name <id> [value <x>]
+void Skunk::parse_setoption(const std::string& command) {
+    size_t name = command.find("name ");
+    if (name == std::string::npos) return;
+    size_t value = command.find(" value ", name);
+    std::string id = command.substr(name + 5, value == std::string::npos ? std::string::npos : value - name - 5);
+    std::string argument = value == std::string::npos ? "" : command.substr(value + 7);
+
+    if (id == "Hash" && !argument.empty()) {
+        long megabytes = std::clamp(std::atol(argument.c_str()), 1L, (long) TranspositionTable::max_megabytes());
+        if (tt.resize(megabytes)) {
+            printf("info string Hash %zu MB, %s\n", tt.megabytes, tt.page_type);
+        } else if (tt.is_shared() || tt.is_file_backed()) {
+            printf("info string Hash stays at %zu MB, the table is %s\n", tt.megabytes, tt.page_type);
+        } else {
+            printf("info string could not allocate a %ld MB hash table, Hash stays at %zu MB\n", megabytes, tt.megabytes);
+        }
+        fflush(stdout);
+    } else if (id == "Move Overhead" && !argument.empty()) {
+        move_overhead = std::clamp(std::atoi(argument.c_str()), 0, 5000);
+    } else if (id == "MultiPV" && !argument.empty()) {
+        multi_pv = std::clamp(std::atoi(argument.c_str()), 1, MAX_MULTI_PV);
+    } else if (id == "Threads" && !argument.empty()) {
+        set_threads(std::atoi(argument.c_str()));
+        printf("info string Threads %zu\n", threads.size());
+        fflush(stdout);
+    } else if (id == "SharedHash") {
+        std::string name = argument == "<empty>" ? "" : argument;
+        if (tt.map_shared(name)) {
+            printf("info string Hash %zu MB, %s%s%s\n", tt.megabytes, tt.page_type, name.empty() ? "" : " ", tt.shared_name.c_str());
+        } else {
+            printf("info string could not attach to shared hash %s\n", name.c_str());
+        }
+        fflush(stdout);
+    } else if (id == "HashFile") {
+        std::string path = argument == "<empty>" ? "" : argument;
+        if (tt.map_file(path)) {
+            printf("info string Hash %zu MB, %s%s%s\n", tt.megabytes, tt.page_type, path.empty() ? "" : " by ", path.c_str());
+        } else {
+            printf("info string could not use %s as the hash file\n", path.c_str());
+        }
+        fflush(stdout);
+    }
+}
@@ -0,0 +1,282 @@
+#ifndef SKUNK_SEARCH_H
+#define SKUNK_SEARCH_H
+
+#include "board.h"
+#include "tt.h"
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+class Skunk;
+
+/*********************\
+   EVALUATION CACHE
+\*********************/
+
+#define EVAL_CACHE_SIZE (1 << 16)
+
+// Direct mapped cache of static evaluations, one per search thread so it needs no synchronisation. A slot
+// keeps the upper 48 bits of the zobrist key (the index comes from the lower bits) and a 16-bit score.
+class EvalCache {
+public:
+    void prefetch(U64 zobristKey) const { __builtin_prefetch(&table[zobristKey & (EVAL_CACHE_SIZE - 1)]); }
+
+
+    bool probe(U64 zobristKey, int &score) const {
+        U64 entry = table[zobristKey & (EVAL_CACHE_SIZE - 1)];
+        if ((entry ^ zobristKey) >> 16) return false;
+        score = (int16_t) (entry & 0xffff);
+        return true;
+    }
+
+    void store(U64 zobristKey, int score) {
+        if (score < INT16_MIN || score > INT16_MAX) return;
+        table[zobristKey & (EVAL_CACHE_SIZE - 1)] = (zobristKey & ~0xffffULL) | (uint16_t) score;
+    }
+
+private:
+    U64 table[EVAL_CACHE_SIZE] = {};
+};
+
+/*********************\
+     SEARCH THREAD
+\*********************/
+
+// the most threads "setoption name Threads" accepts
+#define MAX_THREADS 256
+// the most lines "setoption name MultiPV" accepts
+#define MAX_MULTI_PV 256
+
+// entries of the search stack below ply 0, so a node can look a couple of plies back without checking for the root
+#define STACK_OFFSET 2
+
+// what the search keeps about one ply of the line it is currently on
+struct SearchStack {
+    int move;           // the move made from this ply, 0 for a null move
+    int static_eval;    // NO_EVAL in check
+    int killers[2];
+    int pv_move;        // this ply's move in the principal variation of the last iteration, searched first
+    int excluded_move;  // left out of the search of this node
+    bool in_check;
+};
+
+// The kind of node negamax is searching, fixed at compile time. The root and PV nodes are searched with an open
+// window and keep the principal variation, NON_PV nodes are the zero window searches that make up most of the tree
+enum NodeType { ROOT, PV, NON_PV };
+
+// one of the root moves a MultiPV search reports, with its score and principal variation
+struct RootLine {
+    int score;
+    t_line line;
+};
+
+// Per-thread search state: a private copy of the root position plus the move ordering heuristics and
+// repetition stack that the search mutates. Only the transposition table is shared with other threads.
+// Thread 0 is the main thread and searches on the caller's thread. Every other thread is a Lazy SMP helper
+// with its own worker that stays parked between searches.
+class SearchThread {
+public:
+    SearchThread(Skunk *engine, TranspositionTable *tt, int id);
+    ~SearchThread();
+
+    SearchThread(const SearchThread &) = delete;
+    SearchThread &operator=(const SearchThread &) = delete;
+
+    const int id;
+
+    Position pos;
+
+    // repitition array for 3 move repitition
+    t_repitition repitition;
+
+
+    // History table (for each piece type and destination square)
+    int history_table[12][64];
+
+    t_line previous_pv_line;
+
+    // the lines of the last completed iteration, best first. pv_index is the line being searched, the root
+    // skips the first pv_index root_moves, the moves of the lines already found in this iteration
+    std::vector<RootLine> root_lines;
+    int root_moves[MAX_MULTI_PV];
+    int pv_index = 0;
+
+    int ply = 0;
+    // indexed by ply + STACK_OFFSET, negamax stops growing the line before it runs off the end
+    SearchStack stack[MAX_PLY + STACK_OFFSET];
+    SearchStack *stack_at(int at_ply) { return &stack[at_ply + STACK_OFFSET]; }
+
+    // Triangular PV table: row p holds the best line found from ply p, pv_length[p] moves long. Only PV nodes
+    // write to it, a new best move at ply p is followed by the row of ply p + 1
+    int pv_table[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+    U64 nodes = 0;
+    U64 q_nodes = 0;
+    int cache_hit = 0;
+    size_t null_move_pruned = 0;
+    int eval_probes = 0;
+    int eval_hits = 0;
+
+    EvalCache eval_cache;
+    PawnHashTable pawn_table;
+
+    // result of the deepest completed iteration, what the threads vote with
+    int best_move = 0;
+    int best_score = 0;
+    int completed_depth = 0;
+
+    // wake the parked worker to search, and wait until it is parked again
+    void start_searching(int max_depth);
+    void wait_for_search_finished();
+
+    int search(int maxDepth);
+    template <NodeType node>
+    int negamax(int alpha, int beta, int depth, int verify, int do_null);
+    int quiesence(int alpha, int beta);
+    int evaluate();
+    void prefetch_child(int move);
+    void init_heuristics();
+    void update_heuristics(int ply, int move, int depth);
+    int score_move(int move);
+    void sort_moves(int *moves, int num_moves);
+    void show_sort();
+    void print_moves(t_moves &moves_list);
+    int is_repetition();
+    bool should_do_null_move();
+    // the "go nodes" budget, only the main thread counts it
+    bool out_of_nodes() const;
+
+private:
+    void idle_loop();
+    bool excluded_at_root(int move) const;
+    void print_line(int multipv, int depth, const RootLine &root_line, long elapsed, const char *bound = "");
+    void update_pv(int move);
+    t_line root_pv() const;
+    void set_pv_moves(const t_line &line);
+
+    Skunk *engine;
+    TranspositionTable *tt;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool searching = true;
+    bool exiting = false;
+    int max_depth = 0;
+};
+
+
+/*********************\
+     TIME MANAGER
+\*********************/
+
+// Turns the clock into a budget for one move. The optimum is when the main thread stops starting new
+// iterations, scaled up while the best move keeps changing or the score falls. The maximum is the hard
+// deadline the engine's timer enforces. Both are in milliseconds from when our clock started.
+struct TimeManager {
+    bool enabled = false;
+    int optimum = 0;
+    int maximum = 0;
+    // when our clock started, later than "go" when pondering
+    std::atomic<long> origin{0};
+
+    void init(int time, int increment, int moves_to_go, int overhead);
+    void init_fixed(int move_time, int overhead);
+    void disable();
+    // called by the main thread after each completed iteration
+    bool should_stop(long elapsed, long iteration_time, int best_move, int score);
+
+private:
+    double best_move_changes = 0;
+    int previous_best_move = 0;
+    int previous_score = 0;
+};
+
+
+/*********************\
+    SKUNK CLASS
+\*********************/
+
+// The engine: owns the game position, the transposition table and the search threads, and handles the UCI commands.
+class Skunk {
+public:
+    Skunk();
+    ~Skunk();
+
+    // the game position and the positions that led to it (for repetition detection)
+    Position position;
+    t_repitition repitition;
+
+    // the "position" command the game was set up from and the moves played since, so a command that only
+    // appends moves can be applied incrementally
+    std::string game_base;
+    std::vector<std::string> game_moves;
+
+    TranspositionTable tt;
+    // threads[0] is the main thread
+    std::vector<SearchThread *> threads;
+
+    bool parse_fen(const std::string& fen);
+    int search(int maxDepth);
+    void start_search(int maxDepth);
+    void wait_for_search();
+    void stop_search();
+    void ponderhit();
+    void run_search(int maxDepth);
+    void set_threads(int count);
+    SearchThread *pick_best_thread();
+
+    // UCI commands/helper functions
+
+    int parse_move(const std::string& move_string);
+    void parse_position(const std::string& command);
+    void parse_go(const std::string& cmd);
+    void parse_perft(const std::string& move_string);
+    void parse_setoption(const std::string& command);
+
+    // time functions to incorporate time checking
+    std::chrono::steady_clock::time_point start_time;
+
+    const char *fen_start = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    std::atomic<bool> force_stop{false};
+    // when "stop" arrived (steady clock nanoseconds), 0 if the search ends by itself
+    std::atomic<long long> stop_requested{0};
+    TimeManager time_manager;
+    // set by "go ponder" until "ponderhit" or "stop"
+    std::atomic<bool> pondering{false};
+    // "go infinite": the search runs until "stop" and only reports then
+    std::atomic<bool> infinite{false};
+    // "go nodes" and "go mate", 0 when not given
+    U64 node_limit = 0;
+    int mate_limit = 0;
+    // how many of the best root moves are searched and reported, "setoption name MultiPV"
+    int multi_pv = 1;
+    // held while writing to stdout, the UCI thread answers "isready" while the search prints
+    std::mutex io_mutex;
+    int wtime = 0;
+    int btime = 0;
+    int winc = 0;
+    int binc = 0;
+    int moves_to_go = 0;
+    int move_overhead = DEFAULT_MOVE_OVERHEAD;
+    int search_depth = 0;
+    int move_time = 0; // default time to search in milliseconds
+    int UCI_AnalyseMode = 1;
+
+private:
+    void start_timer();
+    void stop_timer();
+
+    // enforces the hard time limit, the search itself only looks at the clock between iterations
+    std::thread timer;
+    std::mutex timer_mutex;
+    std::condition_variable timer_condition;
+    bool timer_cancelled = false;
+    bool has_deadline = false;
+    std::chrono::steady_clock::time_point deadline;
+
+    int last_best_move = 0;
+};
+
+#endif //SKUNK_SEARCH_H
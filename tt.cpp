@@ -0,0 +1,381 @@
+#include "tt.h"
+#include <vector>
+#include <stdio.h>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TranspositionTable::TranspositionTable(size_t megabytes) {
+    if (!allocate(megabytes)) {
+        fprintf(stderr, "Could not allocate a %zu MB hash table\n", megabytes);
+        exit(1);
+    }
+}
+
+TranspositionTable::~TranspositionTable() {
+    release();
+}
+
+bool TranspositionTable::resize(size_t megabytes) {
+    // a file or shared segment keeps the size it was created with, resizing would throw away what it holds
+    // (and, for a segment, the table of every other process using it)
+    if (is_shared() || is_file_backed()) return false;
+
+    return allocate(megabytes);
+}
+
+// the physical memory of the host, a table larger than that could only be backed by swap
+size_t TranspositionTable::max_megabytes() {
+#ifdef _WIN32
+    return MAX_HASH_MB;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES), page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || page_size <= 0) return MAX_HASH_MB;
+    return std::clamp<size_t>(((size_t) pages * page_size) >> 20, 1, MAX_HASH_MB);
+#endif
+}
+
+void TranspositionTable::set_size(size_t megabytes) {
+    this->megabytes = std::max<size_t>(1, megabytes);
+    size_t bytes = this->megabytes << 20;
+    allocated = (bytes + TT_PAGE_SIZE - 1) & ~(TT_PAGE_SIZE - 1);
+    buckets = bytes / sizeof(TTBucket);
+    generation = 0;
+}
+
+// Maps the new table before letting go of the old one, so a size the host cannot back leaves the current
+// table in place and returns false
+bool TranspositionTable::allocate(size_t megabytes) {
+    megabytes = std::max<size_t>(1, megabytes);
+    size_t bytes = ((megabytes << 20) + TT_PAGE_SIZE - 1) & ~(TT_PAGE_SIZE - 1);
+    const char *pages;
+
+#ifdef _WIN32
+    void *memory = _aligned_malloc(bytes, TT_PAGE_SIZE);
+    if (memory == nullptr) return false;
+    pages = "4K pages";
+#else
+    void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // explicit huge pages only exist if the administrator reserved some, so this usually fails
+    memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    pages = "2M pages (hugetlbfs)";
+#endif
+    if (memory == MAP_FAILED) {
+        // over map by a page and trim the ends so the table starts on a 2 MB boundary
+        size_t length = bytes + TT_PAGE_SIZE;
+        char *raw = (char *) mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return false;
+        char *aligned = (char *) (((uintptr_t) raw + TT_PAGE_SIZE - 1) & ~(TT_PAGE_SIZE - 1));
+        if (aligned > raw) munmap(raw, aligned - raw);
+        size_t tail = (raw + length) - (aligned + bytes);
+        if (tail) munmap(aligned + bytes, tail);
+        memory = aligned;
+        pages = "4K pages";
+#ifdef MADV_HUGEPAGE
+        // only a request, whether the kernel backs the table with huge pages is up to it
+        if (madvise(memory, bytes, MADV_HUGEPAGE) == 0) pages = "transparent huge pages requested";
+#endif
+    }
+#endif
+
+    release();
+    set_size(megabytes);
+    table = (TTBucket *) memory;
+    page_type = pages;
+
+    // anonymous mappings are already zero, but touching them here decides where the pages live
+    clear();
+    return true;
+}
+
+void TranspositionTable::release() {
+    if (table == nullptr) return;
+#ifdef _WIN32
+    _aligned_free(table);
+#else
+    if (mapped_header != nullptr) {
+        munmap(mapped_header, TT_FILE_HEADER_SIZE + allocated);
+        mapped_header = nullptr;
+    } else {
+        munmap(table, allocated);
+    }
+#endif
+    table = nullptr;
+}
+
+// Files and shared segments keep the generation in their header, so all processes attached to the same
+// table age its entries together.
+void TranspositionTable::new_search() {
+    if (mapped_header != nullptr) {
+        generation = __atomic_add_fetch(&mapped_header->generation, 1, __ATOMIC_RELAXED) & TT_GENERATION_MASK;
+    } else {
+        generation = (generation + 1) & TT_GENERATION_MASK;
+    }
+}
+
+// a generation set outright (cleared or loaded) goes to the header too, or the next new_search() would carry on
+// from the header's old count
+void TranspositionTable::set_generation(uint8_t value) {
+    generation = value;
+    if (mapped_header != nullptr) __atomic_store_n(&mapped_header->generation, value, __ATOMIC_RELAXED);
+}
+
+/*********************\
+     FILE BACKING
+\*********************/
+
+// fingerprint of the zobrist keys, a table hashed with different keys is useless
+static U64 key_scheme() {
+    const U64 *words = (const U64 *) &zobrist_keys;
+    U64 hash = 0;
+    for (size_t i = 0; i < sizeof(ZobristKeys) / sizeof(U64); i++) {
+        hash = (hash ^ words[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+TTFileHeader TranspositionTable::header() const {
+    TTFileHeader header = {};
+    header.magic = TT_FILE_MAGIC;
+    header.version = TT_FILE_VERSION;
+    header.bucket_bytes = sizeof(TTBucket);
+    header.key_scheme = key_scheme();
+    header.megabytes = megabytes;
+    header.buckets = buckets;
+    header.generation = generation;
+    return header;
+}
+
+bool TranspositionTable::matches(const TTFileHeader &header) const {
+    return header.magic == TT_FILE_MAGIC && header.version == TT_FILE_VERSION
+           && header.bucket_bytes == sizeof(TTBucket) && header.key_scheme == key_scheme()
+           && header.megabytes > 0 && header.megabytes <= MAX_HASH_MB
+           && header.buckets == (header.megabytes << 20) / sizeof(TTBucket);
+}
+
+bool TranspositionTable::save(const char *path) const {
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) return false;
+
+    char block[TT_FILE_HEADER_SIZE] = {};
+    TTFileHeader current = header();
+    memcpy(block, &current, sizeof(current));
+
+    bool ok = fwrite(block, 1, sizeof(block), file) == sizeof(block)
+              && fwrite(table, sizeof(TTBucket), buckets, file) == buckets;
+    return fclose(file) == 0 && ok;
+}
+
+bool TranspositionTable::load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) return false;
+
+    TTFileHeader saved;
+    if (fread(&saved, sizeof(saved), 1, file) != 1 || !matches(saved)
+        || fseek(file, TT_FILE_HEADER_SIZE, SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    // resize() hands back a cleared table, only a table of the same size still holds old entries
+    if (saved.megabytes != megabytes) {
+        if (!resize(saved.megabytes)) {
+            fclose(file);
+            return false;
+        }
+    } else {
+        clear();
+    }
+
+    bool ok = fread(table, sizeof(TTBucket), buckets, file) == buckets;
+    fclose(file);
+    if (!ok) {
+        clear();
+        return false;
+    }
+    set_generation(saved.generation);
+    return true;
+}
+
+bool TranspositionTable::map_file(const std::string &path) {
+#ifdef _WIN32
+    return path.empty();
+#else
+    if (path.empty()) {
+        if (!file_path.empty()) {
+            if (!allocate(megabytes)) return false;
+            file_path.clear();
+        }
+        return true;
+    }
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    bool ok = attach(fd, megabytes);
+    close(fd);
+    if (ok) {
+        file_path = path;
+        shared_name.clear();
+    }
+    return ok;
+#endif
+}
+
+bool TranspositionTable::map_shared(const std::string &name) {
+#ifdef _WIN32
+    return name.empty();
+#else
+    if (name.empty()) {
+        if (is_shared()) {
+            // detach only, the segment stays for the other processes until it is removed from /dev/shm
+            if (!allocate(megabytes)) return false;
+            shared_name.clear();
+        }
+        return true;
+    }
+
+    // POSIX wants the name to start with a slash
+    std::string segment = name[0] == '/' ? name : "/" + name;
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    bool creator = fd >= 0;
+    if (!creator) fd = shm_open(segment.c_str(), O_RDWR, 0600);
+    if (fd < 0) return false;
+
+    // only the process that created the segment sizes it, the others wait for it to write the header
+    bool ok = attach(fd, megabytes, creator);
+    for (int attempt = 0; !ok && !creator && attempt < 100; attempt++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ok = attach(fd, megabytes, false);
+    }
+    close(fd);
+    if (!ok && creator) shm_unlink(segment.c_str());
+    if (ok) {
+        shared_name = segment;
+        file_path.clear();
+        page_type = "shared memory";
+    }
+    return ok;
+#endif
+}
+
+#ifndef _WIN32
+// maps the table from fd, taking over its contents if it holds a valid table and initialising it if empty
+// (when allowed to create it)
+bool TranspositionTable::attach(int fd, size_t megabytes, bool create) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+
+    TTFileHeader existing = {};
+    bool fresh = info.st_size == 0;
+    if (fresh && !create) return false;
+    if (!fresh) {
+        if (pread(fd, &existing, sizeof(existing), 0) != sizeof(existing) || !matches(existing)) return false;
+        megabytes = existing.megabytes;
+    }
+
+    size_t length = TT_FILE_HEADER_SIZE + (((megabytes << 20) + TT_PAGE_SIZE - 1) & ~(TT_PAGE_SIZE - 1));
+    if (fresh ? ftruncate(fd, length) != 0 : (size_t) info.st_size != length) return false;
+
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) return false;
+
+    // the old table is only dropped once the new one is in place, a freshly truncated file reads as zeroes
+    release();
+    set_size(megabytes);
+    mapped_header = (TTFileHeader *) memory;
+    table = (TTBucket *) ((char *) memory + TT_FILE_HEADER_SIZE);
+    page_type = "file backed";
+
+    if (fresh) {
+        *mapped_header = header();
+    } else {
+        generation = existing.generation;
+    }
+    return true;
+}
+#endif
+
+/*
+ * Zeroes the table from one thread per core, each writing its own run of 2 MB pages. Besides cutting the
+ * time for multi-GB tables, the first write to a page places it on the writer's NUMA node, so a fresh
+ * table ends up spread across the nodes rather than all on the node of the UCI thread.
+ */
+void TranspositionTable::clear() {
+    size_t pages = allocated / TT_PAGE_SIZE;
+    size_t workers = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, pages);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < workers; i++) {
+        size_t first = pages * i / workers, last = pages * (i + 1) / workers;
+        auto zero = [this, first, last]() {
+            memset((char *) table + first * TT_PAGE_SIZE, 0, (last - first) * TT_PAGE_SIZE);
+        };
+        if (i + 1 == workers) zero();
+        else threads.emplace_back(zero);
+    }
+    for (std::thread &thread : threads) thread.join();
+
+    set_generation(0);
+}
+
+static inline int data_depth(U64 data) { return (int8_t) (data >> 48); }
+static inline int data_generation(U64 data) { return (int) (data >> 58); }
+
+void TranspositionTable::store(U64 zobristKey, int value, int eval, int depth, int move, Bound type) {
+    TTBucket *b = bucket(zobristKey);
+    TTEntry *replace = nullptr;
+    uint16_t packed = pack_move(move);
+    int worst = INT_MAX;
+
+    for (TTEntry &entry : b->entries) {
+        U64 data = entry.data;
+        if ((entry.key ^ data) == zobristKey) {
+            // same position, keep the old best move if this search did not find one, and do not let a much
+            // shallower bound (e.g. from quiescence) overwrite a deep result
+            if (type != EXACT && depth + 4 <= data_depth(data)) return;
+            if (!packed) packed = data & 0xffff;
+            replace = &entry;
+            break;
+        }
+        // prefer to evict shallow entries left over from earlier searches
+        int age = (generation - data_generation(data)) & TT_GENERATION_MASK;
+        int score = data_depth(data) - TT_AGE_WEIGHT * age;
+        if (score < worst) {
+            worst = score;
+            replace = &entry;
+        }
+    }
+
+    U64 data = (U64) packed
+               | (U64) (uint16_t) std::clamp(value, INT16_MIN + 1, (int) INT16_MAX) << 16
+               | (U64) (uint16_t) std::clamp(eval, (int) INT16_MIN, (int) INT16_MAX) << 32
+               | (U64) (uint8_t) std::clamp(depth, (int) INT8_MIN, (int) INT8_MAX) << 48
+               | (U64) type << 56
+               | (U64) generation << 58;
+
+    replace->key = zobristKey ^ data;
+    replace->data = data;
+}
+
+bool TranspositionTable::probe(U64 zobristKey, TTData &out) const {
+    const TTBucket *b = bucket(zobristKey);
+
+    for (const TTEntry &entry : b->entries) {
+        U64 data = entry.data;
+        if ((entry.key ^ data) != zobristKey) continue;
+
+        out.move = (int) (data & 0xffff);
+        out.value = (int16_t) (data >> 16);
+        out.eval = (int16_t) (data >> 32);
+        out.depth = data_depth(data);
+        out.type = (Bound) ((data >> 56) & 3);
+        return true;
+    }
+    return false;
+}
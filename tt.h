@@ -0,0 +1,150 @@
+#ifndef SKUNK_TT_H
+#define SKUNK_TT_H
+
+#include "board.h"
+
+/*********************\
+  TRANSPOSITION TABLE
+\*********************/
+
+enum Bound { LOWER_BOUND, UPPER_BOUND, EXACT };
+
+#define TT_BUCKET_SIZE 4
+#define TT_GENERATION_MASK 63
+#define TT_AGE_WEIGHT 8
+#define NO_EVAL INT16_MIN
+
+// tables are allocated in multiples of (and aligned to) a 2 MB huge page
+#define TT_PAGE_SIZE ((size_t) 2 << 20)
+#define MAX_HASH_MB (1 << 20)
+
+/*
+ * A slot is two 64-bit words. data packs the move (16 bits), value (16), static eval (16), depth (8),
+ * bound (2) and generation (6); key holds zobrist ^ data. Each word is written with a single store, so a
+ * reader that catches another thread half way through a store sees a key that no longer verifies and
+ * treats the slot as a miss. No locks are needed and the check still covers the full 64-bit key.
+ */
+struct TTEntry {
+    U64 key;
+    U64 data;
+};
+
+// one cache line
+struct alignas(64) TTBucket {
+    TTEntry entries[TT_BUCKET_SIZE];
+};
+
+static_assert(sizeof(TTBucket) == 64, "a bucket must fill exactly one cache line");
+
+// unpacked copy of a slot handed to the search
+struct TTData {
+    int move;
+    int value;
+    int eval;
+    int depth;
+    Bound type;
+};
+
+// moves are squeezed into 16 bits: source (6), target (6) and the promotion type (3)
+inline uint16_t pack_move(int move) {
+    if (!move) return 0;
+    int promoted = decode_promoted(move);
+    return decode_source(move) | (decode_destination(move) << 6) | ((promoted ? promoted % 6 : 0) << 12);
+}
+
+// scores at least this close to CHECKMATE are mates
+#define MATE_BOUND (CHECKMATE - 2000)
+
+// Mate scores count plies from the root. The table stores them relative to the node instead, so an entry
+// reached at a different ply (a transposition, or the next search) still reports the right mate distance.
+inline int value_to_tt(int value, int ply) {
+    if (value >= MATE_BOUND) return value + ply;
+    if (value <= -MATE_BOUND) return value - ply;
+    return value;
+}
+
+inline int value_from_tt(int value, int ply) {
+    if (value >= MATE_BOUND) return value - ply;
+    if (value <= -MATE_BOUND) return value + ply;
+    return value;
+}
+
+#define TT_FILE_MAGIC 0x5454204b4e554b53ULL // "SKUNK TT"
+#define TT_FILE_VERSION 1
+// the table starts this far into a saved or file backed table, so it can be mapped at a page boundary
+#define TT_FILE_HEADER_SIZE 4096
+
+// Describes the table that follows it in a file. A file is only used when every field matches this build:
+// the same layout version, bucket size and zobrist keys, or its entries would be read as garbage.
+struct TTFileHeader {
+    U64 magic;
+    uint32_t version;
+    uint32_t bucket_bytes;
+    U64 key_scheme;
+    U64 megabytes;
+    U64 buckets;
+    uint8_t generation;
+};
+
+// Heap allocated hash table shared by every search thread. The engine owns exactly one.
+class TranspositionTable {
+public:
+    explicit TranspositionTable(size_t megabytes = HASH_SIZE_MB);
+    ~TranspositionTable();
+
+    TranspositionTable(const TranspositionTable &) = delete;
+    TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+    bool probe(U64 zobristKey, TTData &data) const;
+    void store(U64 zobristKey, int value, int eval, int depth, int move, Bound type);
+    void clear();
+    // pulls the bucket for zobristKey into cache ahead of the probe
+    void prefetch(U64 zobristKey) const { __builtin_prefetch(bucket(zobristKey)); }
+    // drops every entry and reallocates the table at the given size. A file backed or shared table keeps its
+    // size and contents, and false is returned
+    bool resize(size_t megabytes);
+    // called once per search so entries from older searches lose replacement priority
+    void new_search();
+
+    // write the table to a file, or replace it with one written earlier (resizing to match)
+    bool save(const char *path) const;
+    bool load(const char *path);
+    // Keeps the table in a shared mapping of path rather than anonymous memory, so everything the search
+    // stores is on disk when the engine exits. An existing valid file is picked up as is, at its own size.
+    // An empty path goes back to anonymous memory.
+    bool map_file(const std::string &path);
+    // Same as map_file but with a named POSIX shared memory segment, so every engine process on the host that
+    // names the same segment searches with one table. The first process creates it at its current size.
+    bool map_shared(const std::string &name);
+    bool is_shared() const { return !shared_name.empty(); }
+    bool is_file_backed() const { return !file_path.empty(); }
+    // the largest Hash worth offering on this host
+    static size_t max_megabytes();
+
+    size_t megabytes = 0;
+    // the kind of pages backing the table, for "info string"
+    const char *page_type = "";
+    std::string file_path;
+    std::string shared_name;
+
+private:
+    TTBucket *bucket(U64 zobristKey) const {
+        return &table[(size_t) (((unsigned __int128) zobristKey * buckets) >> 64)];
+    }
+
+    bool allocate(size_t megabytes);
+    bool attach(int fd, size_t megabytes, bool create = true);
+    void release();
+    void set_size(size_t megabytes);
+    void set_generation(uint8_t value);
+    TTFileHeader header() const;
+    bool matches(const TTFileHeader &header) const;
+
+    TTBucket *table = nullptr;
+    TTFileHeader *mapped_header = nullptr;
+    size_t buckets = 0;
+    size_t allocated = 0;
+    uint8_t generation = 0;
+};
+
+#endif //SKUNK_TT_H